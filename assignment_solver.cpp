@@ -0,0 +1,545 @@
+#include "assignment_solver.hpp"
+#include "munkres_algorithm.cpp"
+#include "pose_metrics.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include <limits>
+
+/* Copies the negated scores of a link into 'scratch.cost'. With 'prune' set, rows and columns
+   without any edge above 'threshold' are left out and the remaining sub-threshold edges cost
+   nothing, so no solver prefers them over leaving a peak unmatched. 'transpose' stores the
+   problem with columns as rows. Returns the number of kept rows and columns. */
+static void
+prepare_cost_graph(MatrixView<float> score_graph, int nrows, int ncols, float threshold,
+                   bool prune, bool transpose, AssignmentScratch &scratch, int &kept_rows,
+                   int &kept_cols)
+{
+  kept_rows = 0;
+  kept_cols = 0;
+  if (!prune)
+  {
+    for (int i = 0; i < nrows; i++)
+      scratch.row_map[kept_rows++] = i;
+    for (int j = 0; j < ncols; j++)
+      scratch.col_map[kept_cols++] = j;
+  }
+  else
+  {
+    /* 'used' flags the columns with at least one candidate */
+    memset(scratch.used.data(), 0, ncols);
+    for (int i = 0; i < nrows; i++)
+    {
+      bool keep = false;
+      for (int j = 0; j < ncols; j++)
+      {
+        if (score_graph[i][j] > threshold)
+        {
+          keep = true;
+          scratch.used[j] = 1;
+        }
+      }
+      if (keep)
+        scratch.row_map[kept_rows++] = i;
+    }
+    for (int j = 0; j < ncols; j++)
+    {
+      if (scratch.used[j])
+        scratch.col_map[kept_cols++] = j;
+    }
+  }
+
+  MatrixView<float> cost_graph = scratch.costGraph();
+  for (int i = 0; i < kept_rows; i++)
+  {
+    const float *scores = score_graph[scratch.row_map[i]];
+    for (int j = 0; j < kept_cols; j++)
+    {
+      float score = scores[scratch.col_map[j]];
+      float cost = (prune && score <= threshold) ? 0.0f : -score;
+      if (transpose)
+        cost_graph[j][i] = cost;
+      else
+        cost_graph[i][j] = cost;
+    }
+  }
+}
+
+/* The original O(n^3) Munkres solver on a dense cost matrix */
+class MunkresSolver : public AssignmentSolver
+{
+public:
+  void solve(MatrixView<float> score_graph, int nrows, int ncols, float threshold, bool prune,
+             AssignmentScratch &scratch, PairGraph &matches) const override
+  {
+    matches.resize(nrows, ncols);
+    matches.clear();
+
+    int kept_rows, kept_cols;
+    prepare_cost_graph(score_graph, nrows, ncols, threshold, prune, false, scratch,
+                       kept_rows, kept_cols);
+    if (!kept_rows || !kept_cols)
+      return;
+
+    PairGraph &star_graph = scratch.compact_graph;
+    star_graph.resize(kept_rows, kept_cols);
+    int iterations = munkres_algorithm(scratch.costGraph(), star_graph, scratch.prime_graph,
+                                       scratch.cover_table, kept_rows, kept_cols);
+    if (pose_metrics().isEnabled())
+      ThreadMetrics::add(pose_metrics().local().munkres_iterations, iterations);
+
+    for (int i = 0; i < kept_rows; i++)
+    {
+      if (star_graph.isRowSet(i))
+        matches.set(scratch.row_map[i], scratch.col_map[star_graph.colForRow(i)]);
+    }
+  }
+};
+
+/**
+ * Jonker-Volgenant solver on a sparse cost graph. Only the candidate pairs are
+ * stored, in CSR form, so the work follows the number of edges instead of the
+ * size of the score matrix. Row i gets a dummy column 'm + i' and column j a
+ * dummy row 'n + j' at no cost, and every edge (i, j) a dummy edge
+ * (n + j, m + i), so leaving a peak unmatched is always possible and the
+ * problem always has a complete assignment. It is solved in the usual phases:
+ * column reduction, reduction transfer, two rounds of augmenting row reduction
+ * and a shortest augmenting path search for the rows still free.
+ */
+class LapjvSolver : public AssignmentSolver
+{
+public:
+  void solve(MatrixView<float> score_graph, int nrows, int ncols, float threshold, bool prune,
+             AssignmentScratch &scratch, PairGraph &matches) const override
+  {
+    matches.resize(nrows, ncols);
+    matches.clear();
+
+    int n, m;
+    int size = build_cost_graph(score_graph, nrows, ncols, threshold, prune, scratch, n, m);
+    if (!n)
+      return;
+
+    int num_free = reduce_columns(size, scratch);
+    for (int round = 0; round < 2 && num_free; round++)
+      num_free = reduce_rows(size, num_free, scratch);
+    for (int f = 0; f < num_free; f++)
+      augment(scratch.free_rows[f], scratch);
+
+    for (int i = 0; i < n; i++)
+    {
+      int j = scratch.x[i];
+      if (j >= 0 && j < m)
+        matches.set(scratch.row_map[i], scratch.col_map[j]);
+    }
+  }
+
+private:
+  static inline bool is_edge(float score, float threshold, bool prune)
+  {
+    return !prune || score > threshold;
+  }
+
+  /* Fills the CSR graph with the 'n' rows and 'm' columns that have at least one edge, followed by
+     their dummies. Returns the size of the square problem. */
+  static int build_cost_graph(MatrixView<float> score_graph, int nrows, int ncols, float threshold,
+                              bool prune, AssignmentScratch &scratch, int &n, int &m)
+  {
+    n = 0;
+    m = 0;
+    memset(scratch.used.data(), 0, ncols);
+    for (int i = 0; i < nrows; i++)
+    {
+      bool keep = false;
+      for (int j = 0; j < ncols; j++)
+      {
+        if (is_edge(score_graph[i][j], threshold, prune))
+        {
+          keep = true;
+          scratch.used[j] = 1;
+        }
+      }
+      if (keep)
+        scratch.row_map[n++] = i;
+    }
+    for (int j = 0; j < ncols; j++)
+    {
+      if (scratch.used[j])
+        scratch.col_map[m++] = j;
+    }
+
+    int *first = scratch.first.data();
+    int *cols = scratch.cols.data();
+    float *costs = scratch.costs.data();
+    int num_edges = 0;
+    for (int i = 0; i < n; i++)
+    {
+      first[i] = num_edges;
+      const float *scores = score_graph[scratch.row_map[i]];
+      for (int j = 0; j < m; j++)
+      {
+        float score = scores[scratch.col_map[j]];
+        if (is_edge(score, threshold, prune))
+        {
+          cols[num_edges] = j;
+          costs[num_edges++] = -score;
+        }
+      }
+      cols[num_edges] = m + i;
+      costs[num_edges++] = 0.0f;
+    }
+    for (int j = 0; j < m; j++)
+    {
+      first[n + j] = num_edges;
+      cols[num_edges] = j;
+      costs[num_edges++] = 0.0f;
+      for (int i = 0; i < n; i++)
+      {
+        if (is_edge(score_graph[scratch.row_map[i]][scratch.col_map[j]], threshold, prune))
+        {
+          cols[num_edges] = m + i;
+          costs[num_edges++] = 0.0f;
+        }
+      }
+    }
+    first[n + m] = num_edges;
+    return n + m;
+  }
+
+  /* Column reduction and reduction transfer. Every column takes the cheapest row, rows winning
+     several columns keep the cheapest one and the potential of the column of a row that won only
+     one is lowered as far as the row's second choice allows. Returns the number of free rows. */
+  static int reduce_columns(int size, AssignmentScratch &scratch)
+  {
+    const int *first = scratch.first.data();
+    const int *cols = scratch.cols.data();
+    const float *costs = scratch.costs.data();
+    float *v = scratch.v.data();
+    int *x = scratch.x.data();
+    int *y = scratch.y.data();
+    char *wins = scratch.state.data();
+
+    const float inf = std::numeric_limits<float>::infinity();
+    std::fill(v, v + size, inf);
+    std::fill(x, x + size, -1);
+    std::fill(wins, wins + size, 0);
+    for (int i = 0; i < size; i++)
+    {
+      for (int e = first[i]; e < first[i + 1]; e++)
+      {
+        if (costs[e] < v[cols[e]])
+        {
+          v[cols[e]] = costs[e];
+          y[cols[e]] = i;
+        }
+      }
+    }
+
+    for (int j = size - 1; j >= 0; j--)
+    {
+      int i = y[j];
+      if (!wins[i])
+      {
+        wins[i] = 1;
+        x[i] = j;
+      }
+      else
+      {
+        wins[i] = 2;
+        if (v[j] < v[x[i]])
+        {
+          y[x[i]] = -1;
+          x[i] = j;
+        }
+        else
+        {
+          y[j] = -1;
+        }
+      }
+    }
+
+    int num_free = 0;
+    for (int i = 0; i < size; i++)
+    {
+      if (!wins[i])
+      {
+        scratch.free_rows[num_free++] = i;
+      }
+      else if (wins[i] == 1)
+      {
+        /* Every row has its own edge and a dummy one, so the minimum is finite */
+        float second = inf;
+        for (int e = first[i]; e < first[i + 1]; e++)
+        {
+          if (cols[e] != x[i])
+            second = std::min(second, costs[e] - v[cols[e]]);
+        }
+        v[x[i]] -= second;
+      }
+    }
+    std::fill(wins, wins + size, 0);
+    return num_free;
+  }
+
+  /* One round of augmenting row reduction: each free row takes its cheapest column, lowering its
+     potential to the row's second choice, and the row it displaces is reduced next if that made
+     the column strictly cheaper. Returns the number of rows left free. */
+  static int reduce_rows(int size, int num_free, AssignmentScratch &scratch)
+  {
+    const int *first = scratch.first.data();
+    const int *cols = scratch.cols.data();
+    const float *costs = scratch.costs.data();
+    float *v = scratch.v.data();
+    int *x = scratch.x.data();
+    int *y = scratch.y.data();
+    int *free_rows = scratch.free_rows.data();
+
+    /* Rounding can make two rows take a column from each other forever, the augmentation
+       finishes whatever is left */
+    int budget = 8 * size;
+    int k = 0;
+    int prev_free = num_free;
+    num_free = 0;
+    while (k < prev_free)
+    {
+      if (!budget--)
+      {
+        while (k < prev_free)
+          free_rows[num_free++] = free_rows[k++];
+        break;
+      }
+
+      int i = free_rows[k++];
+      float best = std::numeric_limits<float>::infinity();
+      float second = best;
+      int j1 = -1;
+      int j2 = -1;
+      for (int e = first[i]; e < first[i + 1]; e++)
+      {
+        float h = costs[e] - v[cols[e]];
+        if (h < second)
+        {
+          if (h >= best)
+          {
+            second = h;
+            j2 = cols[e];
+          }
+          else
+          {
+            second = best;
+            best = h;
+            j2 = j1;
+            j1 = cols[e];
+          }
+        }
+      }
+
+      int i0 = y[j1];
+      if (best < second)
+        v[j1] -= second - best;
+      else if (i0 >= 0)
+      {
+        j1 = j2;
+        i0 = y[j2];
+      }
+      x[i] = j1;
+      y[j1] = i;
+      if (i0 >= 0)
+      {
+        x[i0] = -1;
+        if (best < second)
+          free_rows[--k] = i0;
+        else
+          free_rows[num_free++] = i0;
+      }
+    }
+    return num_free;
+  }
+
+  /* Dijkstra search on reduced costs from 'free_row' to the nearest unassigned column, visiting
+     only the edges of the rows it reaches, then flips the path and updates the potentials of the
+     scanned columns */
+  static void augment(int free_row, AssignmentScratch &scratch)
+  {
+    enum
+    {
+      UNSEEN = 0,
+      REACHED,
+      SCANNED
+    };
+    const int *first = scratch.first.data();
+    const int *cols = scratch.cols.data();
+    const float *costs = scratch.costs.data();
+    float *v = scratch.v.data();
+    float *d = scratch.d.data();
+    int *x = scratch.x.data();
+    int *y = scratch.y.data();
+    int *pred = scratch.pred.data();
+    int *todo = scratch.todo.data();
+    int *done = scratch.done.data();
+    char *state = scratch.state.data();
+
+    int num_todo = 0;
+    int num_done = 0;
+    for (int e = first[free_row]; e < first[free_row + 1]; e++)
+    {
+      int j = cols[e];
+      d[j] = costs[e] - v[j];
+      pred[j] = free_row;
+      state[j] = REACHED;
+      todo[num_todo++] = j;
+    }
+
+    int end = -1;
+    float shortest = 0.0f;
+    while (num_todo)
+    {
+      /* Closest reached column, an unassigned one on ties */
+      int best = 0;
+      for (int t = 1; t < num_todo; t++)
+      {
+        int j = todo[t], b = todo[best];
+        if (d[j] < d[b] || (d[j] == d[b] && y[j] < 0 && y[b] >= 0))
+          best = t;
+      }
+      int j = todo[best];
+      todo[best] = todo[--num_todo];
+      shortest = d[j];
+      if (y[j] < 0)
+      {
+        end = j;
+        break;
+      }
+      state[j] = SCANNED;
+      done[num_done++] = j;
+
+      int i = y[j];
+      float assigned = 0.0f;
+      for (int e = first[i]; e < first[i + 1]; e++)
+      {
+        if (cols[e] == j)
+          assigned = costs[e];
+      }
+      float h = assigned - v[j] - shortest;
+      for (int e = first[i]; e < first[i + 1]; e++)
+      {
+        int k = cols[e];
+        if (state[k] == SCANNED)
+          continue;
+        float dist = costs[e] - v[k] - h;
+        if (state[k] == UNSEEN)
+        {
+          state[k] = REACHED;
+          d[k] = dist;
+          pred[k] = i;
+          todo[num_todo++] = k;
+        }
+        else if (dist < d[k])
+        {
+          d[k] = dist;
+          pred[k] = i;
+        }
+      }
+    }
+
+    for (int t = 0; t < num_done; t++)
+    {
+      v[done[t]] += d[done[t]] - shortest;
+      state[done[t]] = UNSEEN;
+    }
+    for (int t = 0; t < num_todo; t++)
+      state[todo[t]] = UNSEEN;
+    if (end < 0)
+      return;
+    state[end] = UNSEEN;
+
+    while (true)
+    {
+      int i = pred[end];
+      y[end] = i;
+      int next = x[i];
+      x[i] = end;
+      if (i == free_row)
+        break;
+      end = next;
+    }
+  }
+};
+
+/**
+ * Matches edges in decreasing score order while both peaks are free. Not
+ * optimal in general, but O(E log E) and close to the optimum on well separated
+ * people. Sub-threshold edges can only ever be matched last, so 'prune' just
+ * keeps them out of the sort.
+ */
+class GreedySolver : public AssignmentSolver
+{
+public:
+  void solve(MatrixView<float> score_graph, int nrows, int ncols, float threshold, bool prune,
+             AssignmentScratch &scratch, PairGraph &matches) const override
+  {
+    matches.resize(nrows, ncols);
+    matches.clear();
+
+    AssignmentEdge *edges = scratch.edges.data();
+    int num_edges = 0;
+    for (int i = 0; i < nrows; i++)
+    {
+      for (int j = 0; j < ncols; j++)
+      {
+        float score = score_graph[i][j];
+        if (!prune || score > threshold)
+          edges[num_edges++] = {score, i, j};
+      }
+    }
+
+    /* Ties are broken by position so the result does not depend on the sort */
+    std::sort(edges, edges + num_edges, [](const AssignmentEdge &a, const AssignmentEdge &b) {
+      if (a.score != b.score)
+        return a.score > b.score;
+      if (a.row != b.row)
+        return a.row < b.row;
+      return a.col < b.col;
+    });
+
+    for (int e = 0; e < num_edges; e++)
+    {
+      if (!matches.isRowSet(edges[e].row) && !matches.isColSet(edges[e].col))
+        matches.set(edges[e].row, edges[e].col);
+    }
+  }
+};
+
+/* Solvers hold no state of their own, one shared instance of each is enough */
+const AssignmentSolver &assignment_solver(AssignmentSolverType type)
+{
+  static const MunkresSolver munkres;
+  static const LapjvSolver lapjv;
+  static const GreedySolver greedy;
+
+  switch (type)
+  {
+  case ASSIGNMENT_SOLVER_LAPJV:
+    return lapjv;
+  case ASSIGNMENT_SOLVER_GREEDY:
+    return greedy;
+  default:
+    return munkres;
+  }
+}
+
+/* Names of the solvers, in AssignmentSolverType order */
+static const char *assignment_solver_names[] = {"munkres", "lapjv", "greedy"};
+
+bool assignment_solver_from_string(const char *name, AssignmentSolverType &type)
+{
+  for (int i = 0; i < (int)(sizeof(assignment_solver_names) / sizeof(assignment_solver_names[0])); i++)
+  {
+    if (!strcmp(name, assignment_solver_names[i]))
+    {
+      type = (AssignmentSolverType)i;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "matrix_view.hpp"
+#include "pair_graph.hpp"
+#include "cover_table.hpp"
+
+#include <vector>
+
+/* Assignment solvers selectable per deployment */
+enum AssignmentSolverType
+{
+  ASSIGNMENT_SOLVER_MUNKRES = 0,
+  ASSIGNMENT_SOLVER_LAPJV,
+  ASSIGNMENT_SOLVER_GREEDY
+};
+
+/* Candidate pair of a link, used by the greedy matcher */
+struct AssignmentEdge
+{
+  float score;
+  int row;
+  int col;
+};
+
+/**
+ * Scratch memory of one link's assignment. It is sized once for 'max_count'
+ * candidates per side and shared by all solvers, so solving never allocates.
+ */
+struct AssignmentScratch
+{
+  void reserve(int max_count)
+  {
+    this->max_count = max_count;
+    cost.assign(max_count * max_count, 0.0f);
+    row_map.assign(max_count, 0);
+    col_map.assign(max_count, 0);
+    prime_graph.resize(max_count, max_count);
+    cover_table.resize(max_count, max_count);
+    compact_graph.resize(max_count, max_count);
+    used.assign(max_count, 0);
+
+    /* Every peak of either side gets a dummy partner, see LapjvSolver */
+    int size = 2 * max_count;
+    first.assign(size + 1, 0);
+    cols.resize(2 * max_count * max_count + size);
+    costs.resize(2 * max_count * max_count + size);
+    v.assign(size, 0.0f);
+    d.assign(size, 0.0f);
+    x.assign(size, 0);
+    y.assign(size, 0);
+    pred.assign(size, 0);
+    free_rows.assign(size, 0);
+    todo.assign(size, 0);
+    done.assign(size, 0);
+    state.assign(size, 0);
+    edges.resize(max_count * max_count);
+  }
+
+  inline MatrixView<float> costGraph()
+  {
+    return MatrixView<float>(cost.data(), max_count);
+  }
+
+  int max_count = 0;
+
+  /* Solver input, possibly restricted to the rows and columns kept by pruning */
+  std::vector<float> cost;
+  std::vector<int> row_map;
+  std::vector<int> col_map;
+  std::vector<char> used;
+
+  /* Munkres */
+  PairGraph prime_graph;
+  CoverTable cover_table;
+  PairGraph compact_graph;
+
+  /* Jonker-Volgenant: CSR cost graph, column potentials, row and column solutions and
+     the shortest path search of the augmentation */
+  std::vector<int> first;
+  std::vector<int> cols;
+  std::vector<float> costs;
+  std::vector<float> v;
+  std::vector<float> d;
+  std::vector<int> x;
+  std::vector<int> y;
+  std::vector<int> pred;
+  std::vector<int> free_rows;
+  std::vector<int> todo;
+  std::vector<int> done;
+  std::vector<char> state;
+
+  /* Greedy */
+  std::vector<AssignmentEdge> edges;
+};
+
+/**
+ * Matches the peaks of both ends of a link so that the total PAF score is
+ * maximal. With 'prune' set, pairs scoring at most 'threshold' are removed
+ * before solving, so rows and columns without any candidate drop out of the
+ * problem and the remaining ones are never matched to a discarded edge.
+ */
+class AssignmentSolver
+{
+public:
+  virtual ~AssignmentSolver() {}
+
+  virtual void solve(MatrixView<float> score_graph, int nrows, int ncols, float threshold,
+                     bool prune, AssignmentScratch &scratch, PairGraph &matches) const = 0;
+};
@@ -0,0 +1,303 @@
+#pragma once
+
+#include "bounded_queue.hpp"
+#include "post_process_workspace.hpp"
+
+#include <gst/gst.h>
+
+#include "gstnvdsmeta.h"
+#include "gstnvdsinfer.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct PostProcessParams;
+
+/* A frame handed from the inference pad to the post-processing workers */
+struct PostProcessJob
+{
+  PostProcessJob()
+      : buffer(nullptr), frame_meta(nullptr), tensor_meta(nullptr), search_state(nullptr),
+        done(false) {}
+
+  GstBuffer *buffer; /* referenced until the job is released */
+  NvDsFrameMeta *frame_meta;
+  NvDsInferTensorMeta *tensor_meta;
+  PeakSearchState *search_state; /* owned by the frame's source, may be NULL */
+  PostProcessWorkspace workspace;
+  std::atomic<bool> done;
+};
+
+/**
+ * Runs the pose post-processing off the streaming thread. The nvinfer src pad
+ * probe submits every frame and returns right away; a later pad takes the
+ * finished jobs back in submission order and attaches their metadata.
+ *
+ * Frames go to worker 'source_id % num_workers', whose lock-free queue is
+ * FIFO, so the frames of a source are always processed in order by the same
+ * thread. Jobs live in a ring of 'max_in_flight' slots; submit() blocks while
+ * all of them are waiting to be attached, which bounds both the latency added
+ * and the number of buffers held. It must hold at least the frames of one batch,
+ * whose buffer only moves on once all of them are submitted.
+ *
+ * Every worker queue holds the whole ring, so the push never fails and the ring
+ * is the only back-pressure. A worker that finds its queue empty raises its
+ * 'sleeping' flag and parks; submit() only takes the worker's lock to wake it
+ * when that flag is set.
+ *
+ * Buffers reach the attach pad in the order they were submitted, unless one is
+ * dropped or flushed on the way. The jobs of such a buffer are discarded when a
+ * later buffer arrives, or by flush() on FLUSH_STOP and EOS, so they never hold
+ * the ring.
+ */
+class AsyncPostProcessor
+{
+public:
+  typedef int (*ProcessFunc)(NvDsInferTensorMeta *tensor_meta, PostProcessWorkspace &workspace,
+                             PeakSearchState *search_state, const PostProcessParams &params);
+
+  AsyncPostProcessor(int num_workers, int max_in_flight, ProcessFunc process, const PostProcessParams &params)
+      : process(process), params(params), max_in_flight(max_in_flight), stopping(false), submitted(0),
+        attached(0)
+  {
+    this->jobs.reset(new PostProcessJob[max_in_flight]);
+    for (int i = 0; i < num_workers; i++)
+      this->workers.emplace_back(new Worker(max_in_flight));
+    for (int i = 0; i < num_workers; i++)
+      this->workers[i]->thread = std::thread(&AsyncPostProcessor::workerLoop, this, i);
+  }
+
+  /* Drops the buffers that were never attached, once no pad calls in anymore */
+  ~AsyncPostProcessor()
+  {
+    stop();
+
+    long end = this->submitted.load(std::memory_order_acquire);
+    for (long seq = this->attached.load(std::memory_order_relaxed); seq < end; seq++)
+      gst_buffer_unref(this->jobs[seq % this->max_in_flight].buffer);
+  }
+
+  /**
+   * Queues the post-processing of one tensor output of 'buffer', called from
+   * the nvinfer src pad. Holds a reference on 'buffer' until the job is released.
+   * Frames submitted after stop() are passed through without results. 'search_state'
+   * is handed to the process function and must only be shared by frames of one source.
+   */
+  void submit(GstBuffer *buffer, NvDsFrameMeta *frame_meta, NvDsInferTensorMeta *tensor_meta,
+              PeakSearchState *search_state = nullptr)
+  {
+    long seq = this->submitted.load(std::memory_order_relaxed);
+    PostProcessJob *job = &this->jobs[seq % this->max_in_flight];
+    {
+      std::unique_lock<std::mutex> lock(this->attach_mutex);
+      this->attach_cond.wait(lock, [this, seq] {
+        return this->stopping || seq - this->attached.load(std::memory_order_relaxed) < this->max_in_flight;
+      });
+      if (this->stopping)
+        return;
+
+      job->buffer = gst_buffer_ref(buffer);
+      job->frame_meta = frame_meta;
+      job->tensor_meta = tensor_meta;
+      job->search_state = search_state;
+      job->done.store(false, std::memory_order_relaxed);
+      this->submitted.store(seq + 1, std::memory_order_release);
+
+      /* Queued before the lock is dropped, so stop() never lets the workers exit before it.
+       * At most 'max_in_flight' jobs are queued, the push always finds room. */
+      Worker &worker = *this->workers[frame_meta->source_id % this->workers.size()];
+      worker.queue.tryPush(job);
+      wakeWorker(worker);
+    }
+  }
+
+  /**
+   * Returns the next job of 'buffer' once it is processed, or NULL when every
+   * job submitted for 'buffer' has been handed out. Jobs submitted before the
+   * first one of 'buffer' belong to buffers that never reached the attach pad
+   * and are released unattached. Called from the attach pad.
+   */
+  PostProcessJob *next(GstBuffer *buffer)
+  {
+    long seq = this->attached.load(std::memory_order_relaxed);
+    long end = this->submitted.load(std::memory_order_acquire);
+    long first = seq;
+    while (first < end && this->jobs[first % this->max_in_flight].buffer != buffer)
+      first++;
+    if (first == end)
+      return nullptr;
+
+    for (; seq < first; seq++)
+    {
+      PostProcessJob *stale = &this->jobs[seq % this->max_in_flight];
+      waitDone(stale);
+      release(stale);
+    }
+    PostProcessJob *job = &this->jobs[first % this->max_in_flight];
+    waitDone(job);
+    return job;
+  }
+
+  /**
+   * Releases every submitted job unattached, for FLUSH_STOP and EOS at the
+   * attach pad, after which no buffer of those jobs arrives anymore. Must not
+   * run concurrently with next().
+   */
+  void flush()
+  {
+    long end = this->submitted.load(std::memory_order_acquire);
+    for (long seq = this->attached.load(std::memory_order_relaxed); seq < end; seq++)
+    {
+      PostProcessJob *job = &this->jobs[seq % this->max_in_flight];
+      waitDone(job);
+      release(job);
+    }
+  }
+
+  /**
+   * Hands a job obtained from next() back, dropping its buffer reference
+   */
+  void release(PostProcessJob *job)
+  {
+    gst_buffer_unref(job->buffer);
+    job->buffer = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(this->attach_mutex);
+      this->attached.fetch_add(1, std::memory_order_relaxed);
+    }
+    this->attach_cond.notify_all();
+  }
+
+  /**
+   * Stops accepting frames and lets the workers finish the queued ones. Called
+   * before the pipeline is torn down so a submit() waiting for attach room
+   * cannot block the inference thread forever.
+   */
+  void stop()
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->attach_mutex);
+      this->stopping = true;
+    }
+    this->attach_cond.notify_all();
+
+    for (auto &worker : this->workers)
+    {
+      {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->stopping = true;
+        worker->wakeups++;
+      }
+      worker->cond.notify_one();
+    }
+    for (auto &worker : this->workers)
+    {
+      if (worker->thread.joinable())
+        worker->thread.join();
+    }
+  }
+
+private:
+  struct Worker
+  {
+    explicit Worker(int capacity) : queue(capacity), sleeping(false), wakeups(0), stopping(false) {}
+
+    BoundedQueue<PostProcessJob *> queue;
+    std::atomic<bool> sleeping; /* raised by the worker before it parks on 'cond' */
+
+    /* Slow path of the wakeup, only taken while the worker is parked or stopping */
+    std::mutex mutex;
+    std::condition_variable cond;
+    int wakeups;
+    bool stopping;
+    std::thread thread;
+  };
+
+  /* Wakes 'worker' after a push if it parked; the fences pair with those of park() so
+     either the worker sees the job or this sees the flag */
+  static void wakeWorker(Worker &worker)
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!worker.sleeping.load(std::memory_order_relaxed) || !worker.sleeping.exchange(false))
+      return;
+    {
+      std::lock_guard<std::mutex> lock(worker.mutex);
+      worker.wakeups++;
+    }
+    worker.cond.notify_one();
+  }
+
+  /* Takes the next job of 'worker', parking while its queue is empty. Returns false
+     once the worker is stopping and its queue drained. */
+  static bool park(Worker &worker, PostProcessJob *&job)
+  {
+    while (true)
+    {
+      if (worker.queue.tryPop(job))
+        return true;
+
+      worker.sleeping.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (worker.queue.tryPop(job))
+      {
+        worker.sleeping.store(false, std::memory_order_relaxed);
+        return true;
+      }
+
+      std::unique_lock<std::mutex> lock(worker.mutex);
+      worker.cond.wait(lock, [&worker] { return worker.wakeups > 0; });
+      worker.wakeups--;
+      if (worker.stopping)
+      {
+        /* Every submit() queued its job before stop() raised the flag */
+        lock.unlock();
+        worker.sleeping.store(false, std::memory_order_relaxed);
+        if (worker.queue.tryPop(job))
+          return true;
+        return false;
+      }
+    }
+  }
+
+  void waitDone(PostProcessJob *job)
+  {
+    std::unique_lock<std::mutex> lock(this->done_mutex);
+    this->done_cond.wait(lock, [job] { return job->done.load(std::memory_order_acquire); });
+  }
+
+  void workerLoop(int index)
+  {
+    Worker &worker = *this->workers[index];
+    PostProcessJob *job;
+    while (park(worker, job))
+    {
+      this->process(job->tensor_meta, job->workspace, job->search_state, this->params);
+      {
+        std::lock_guard<std::mutex> lock(this->done_mutex);
+        job->done.store(true, std::memory_order_release);
+      }
+      this->done_cond.notify_all();
+    }
+  }
+
+  ProcessFunc process;
+  const PostProcessParams &params;
+  int max_in_flight;
+  bool stopping; /* guarded by 'attach_mutex' */
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::unique_ptr<PostProcessJob[]> jobs;
+
+  /* Ring positions: written by the submitting and the attaching thread respectively */
+  std::atomic<long> submitted;
+  std::atomic<long> attached;
+
+  std::mutex attach_mutex;
+  std::condition_variable attach_cond;
+  std::mutex done_mutex;
+  std::condition_variable done_cond;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+/**
+ * Derives the nvstreammux batch timeout of live sources from their measured
+ * frame intervals. Each source's interval is smoothed from the PTS deltas of
+ * its buffers, and the timeout is the fastest source's interval plus some
+ * slack: a batch then waits about one frame for a late source, instead of
+ * the fixed worst case, before it is pushed incomplete.
+ *
+ * observe() runs on the streaming thread of its source; timeout() may be
+ * called from any thread.
+ */
+class BatchTimeoutController
+{
+public:
+  BatchTimeoutController() : num_sources(0), min_timeout_us(0), max_timeout_us(0) {}
+
+  /* Follows 'num_sources' sources, clamping the timeout to [min_timeout_us, max_timeout_us] */
+  void reset(int num_sources, int64_t min_timeout_us, int64_t max_timeout_us)
+  {
+    this->num_sources = num_sources;
+    this->min_timeout_us = min_timeout_us;
+    this->max_timeout_us = max_timeout_us;
+    this->sources.reset(new SourceClock[num_sources]);
+  }
+
+  /* Records a buffer of 'source' with presentation time 'pts' in nanoseconds */
+  void observe(int source, uint64_t pts)
+  {
+    if (source < 0 || source >= this->num_sources)
+      return;
+    SourceClock &clock = this->sources[source];
+    int64_t delta = clock.has_last ? (int64_t)(pts - clock.last_pts) : 0;
+    clock.last_pts = pts;
+    clock.has_last = true;
+
+    /* Gaps, reordering and jumps across a discontinuity say nothing about the rate */
+    if (delta <= 0 || delta > MAX_FRAME_INTERVAL_NS)
+      return;
+    int64_t interval = clock.interval_ns.load(std::memory_order_relaxed);
+    interval = interval ? interval + (delta - interval) / 8 : delta;
+    clock.interval_ns.store(interval, std::memory_order_relaxed);
+  }
+
+  /* Timeout in microseconds, or 0 while no source has delivered two frames yet */
+  int64_t timeout() const
+  {
+    int64_t fastest = 0;
+    for (int i = 0; i < this->num_sources; i++)
+    {
+      int64_t interval = this->sources[i].interval_ns.load(std::memory_order_relaxed);
+      if (interval && (!fastest || interval < fastest))
+        fastest = interval;
+    }
+    if (!fastest)
+      return 0;
+    int64_t timeout_us = fastest * TIMEOUT_SLACK_PERCENT / 100 / 1000;
+    return std::min(std::max(timeout_us, this->min_timeout_us), this->max_timeout_us);
+  }
+
+private:
+  static const int64_t MAX_FRAME_INTERVAL_NS = 1000000000;
+  static const int64_t TIMEOUT_SLACK_PERCENT = 125;
+
+  struct SourceClock
+  {
+    SourceClock() : has_last(false), last_pts(0), interval_ns(0) {}
+
+    /* Only touched by the source's streaming thread */
+    bool has_last;
+    uint64_t last_pts;
+    std::atomic<int64_t> interval_ns;
+  };
+
+  int num_sources;
+  int64_t min_timeout_us;
+  int64_t max_timeout_us;
+  std::unique_ptr<SourceClock[]> sources;
+};
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+
+/**
+ * Fixed-capacity lock-free multi-producer multi-consumer FIFO (Vyukov's bounded
+ * queue). Every cell carries a sequence number telling producers and consumers
+ * whether it is free for the current lap, so push and pop are a single CAS on
+ * the tail or head index. The capacity is rounded up to a power of two.
+ */
+template <class T>
+class BoundedQueue
+{
+public:
+  explicit BoundedQueue(int capacity)
+  {
+    size_t size = 1;
+    while (size < (size_t)capacity)
+      size <<= 1;
+
+    this->cells.reset(new Cell[size]);
+    this->mask = size - 1;
+    for (size_t i = 0; i < size; i++)
+      this->cells[i].sequence.store(i, std::memory_order_relaxed);
+    this->tail.store(0, std::memory_order_relaxed);
+    this->head.store(0, std::memory_order_relaxed);
+  }
+
+  inline int capacity() const
+  {
+    return (int)(this->mask + 1);
+  }
+
+  /**
+   * Appends 'value', returns false when the queue is full
+   */
+  bool tryPush(const T &value)
+  {
+    size_t pos = this->tail.load(std::memory_order_relaxed);
+    while (true)
+    {
+      Cell &cell = this->cells[pos & this->mask];
+      size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      ptrdiff_t diff = (ptrdiff_t)sequence - (ptrdiff_t)pos;
+      if (diff == 0)
+      {
+        if (this->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          cell.value = value;
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (diff < 0)
+      {
+        return false;
+      }
+      else
+      {
+        pos = this->tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /**
+   * Removes the oldest element into 'value', returns false when the queue is empty
+   */
+  bool tryPop(T &value)
+  {
+    size_t pos = this->head.load(std::memory_order_relaxed);
+    while (true)
+    {
+      Cell &cell = this->cells[pos & this->mask];
+      size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      ptrdiff_t diff = (ptrdiff_t)sequence - (ptrdiff_t)(pos + 1);
+      if (diff == 0)
+      {
+        if (this->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+        {
+          value = cell.value;
+          cell.sequence.store(pos + this->mask + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (diff < 0)
+      {
+        return false;
+      }
+      else
+      {
+        pos = this->head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+private:
+  static const int CACHE_LINE = 64;
+
+  struct Cell
+  {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  std::unique_ptr<Cell[]> cells;
+  size_t mask;
+
+  /* Producers and consumers spin on different cache lines */
+  char pad0[CACHE_LINE];
+  std::atomic<size_t> tail;
+  char pad1[CACHE_LINE - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> head;
+  char pad2[CACHE_LINE - sizeof(std::atomic<size_t>)];
+};
@@ -6,12 +6,22 @@
 class CoverTable
 {
 public:
+  CoverTable() : nrows(0), ncols(0) {}
+
   CoverTable(int nrows, int ncols) : nrows(nrows), ncols(ncols)
   {
     rows.resize(nrows);
     cols.resize(ncols);
   }
 
+  inline void resize(int nrows, int ncols)
+  {
+    this->nrows = nrows;
+    this->ncols = ncols;
+    rows.resize(nrows);
+    cols.resize(ncols);
+  }
+
   inline void coverRow(int row)
   {
     rows[row] = 1;
@@ -59,8 +69,8 @@ public:
     }
   }
 
-  const int nrows;
-  const int ncols;
+  int nrows;
+  int ncols;
 
 private:
   std::vector<bool> rows;
@@ -2,6 +2,14 @@
 // SPDX-License-Identifier: MIT
 
 #include "post_process.cpp"
+#include "tensor_capture.hpp"
+#include "async_post_process.hpp"
+#include "pose_meta.hpp"
+#include "pose_display.hpp"
+#include "pose_tracker.hpp"
+#include "pose_result_writer.hpp"
+#include "post_process_governor.hpp"
+#include "batch_timeout.hpp"
 
 #include <gst/gst.h>
 #include <glib.h>
@@ -16,12 +24,14 @@
 #include <queue>
 #include <cmath>
 #include <string>
+#include <memory>
+#include <atomic>
 
 #define EPS 1e-6
 
 #define MAX_DISPLAY_LEN 64
 
-/* The muxer output resolution must be set if the input streams will be of
+/* Default muxer output resolution. It must be set if the input streams will be of
  * different resolution. The muxer will scale all the input frames to this
  * resolution. */
 #define MUXER_OUTPUT_WIDTH 1920
@@ -31,6 +41,13 @@
  * based on the fastest source's framerate. */
 #define MUXER_BATCH_TIMEOUT_USEC 4000000
 
+/* Live sources start with the timeout of a 25 fps source, which is then adapted every
+ * LIVE_TIMEOUT_UPDATE_MS to the measured frame rates within the bounds below */
+#define LIVE_BATCH_TIMEOUT_USEC 40000
+#define LIVE_MIN_BATCH_TIMEOUT_USEC 1000
+#define LIVE_MAX_BATCH_TIMEOUT_USEC 200000
+#define LIVE_TIMEOUT_UPDATE_MS 1000
+
 template <class T>
 using Vec1D = std::vector<T>;
 
@@ -40,113 +57,319 @@ using Vec2D = std::vector<Vec1D<T>>;
 template <class T>
 using Vec3D = std::vector<Vec2D<T>>;
 
-gint frame_number = 0;
+static PostProcessParams pose_params;
 
-/*Method to parse information returned from the model*/
-std::tuple<Vec2D<int>, Vec3D<float>>
-parse_objects_from_tensor_meta(NvDsInferTensorMeta *tensor_meta)
+/* Picks the parameters of every frame when enabled in the post-processing config */
+static PostProcessGovernor pose_governor;
+
+/* Post-processing config read when no --post-process-config is given and the file exists */
+#define POST_PROCESS_CONFIG_DEFAULT "deepstream_pose_postprocess_config.txt"
+
+/* Work-stealing pool shared by the frames of a batch and the stages of each frame */
+static TaskScheduler *pose_scheduler = NULL;
+
+/* State kept per nvstreammux source, indexed by source_id */
+struct SourceState
 {
-  Vec1D<int> counts;
-  Vec3D<int> peaks;
+  gint frame_number;
+  PoseTracker tracker;
+
+  /* Peaks of the previous frame per tensor output, for the incremental peak search */
+  std::vector<std::unique_ptr<PeakSearchState>> peak_searches;
+};
 
-  float threshold = 0.1;
-  int window_size = 5;
-  int max_num_parts = 20;
-  int num_integral_samples = 7;
-  float link_threshold = 0.1;
-  int max_num_objects = 100;
+static std::vector<SourceState> source_states;
+
+/* A tensor output of the current batch and the workspace its post-processing writes to */
+struct BatchFrame
+{
+  NvDsFrameMeta *frame_meta;
+  NvDsInferTensorMeta *tensor_meta;
+  PostProcessWorkspace *workspace;
+  PeakSearchState *search_state;
+};
+
+static std::vector<BatchFrame> batch_frames;
+
+/* Post-processing buffers, one per tensor output slot of the batch, sized on the first
+   batch and reused for every batch after it. A batch may hold several frames of one source,
+   so they are not kept per source. */
+static std::vector<std::unique_ptr<PostProcessWorkspace>> batch_workspaces;
+
+/* 'batch_parallelism' runner tasks pull frames of the batch until none are left */
+static TaskGraph batch_graph;
+static std::atomic<int> batch_next_frame;
+
+/* Set when the frames are post-processed off the streaming thread */
+static AsyncPostProcessor *pose_async = NULL;
+
+/* Tensor outputs of every frame are appended here when capturing */
+static TensorCaptureWriter tensor_capture;
+
+/* Poses of every frame are streamed here as JSON Lines when requested */
+static PoseResultWriter pose_results;
+
+/* Live mode: frame rates of the sources and the batch timeout derived from them, and the
+ * pipeline whose clock the glass-to-pose latency is measured against */
+static BatchTimeoutController batch_timeout;
+static gint64 batch_timeout_usec = LIVE_BATCH_TIMEOUT_USEC;
+static GstElement *live_pipeline = NULL;
+
+static gint muxer_width = MUXER_OUTPUT_WIDTH;
+static gint muxer_height = MUXER_OUTPUT_HEIGHT;
+
+static gchar *skeleton_name = NULL;
+static gchar *pgie_config_path = NULL;
+static gchar *post_process_config_path = NULL;
+static gchar *peak_detector_name = NULL;
+static gchar *solver_name = NULL;
+static gboolean prune_links = FALSE;
+static gchar *paf_sampling_name = NULL;
+static gdouble paf_sample_spacing = 0.0;
+static gint full_scan_interval = 0;
+static gint search_radius = 3;
+static gdouble search_energy_change = 0.3;
+static gdouble cmap_int8_scale = 1.0 / 127.0;
+static gdouble paf_int8_scale = 1.0 / 127.0;
+static gchar *capture_tensors_path = NULL;
+static gchar *results_path = NULL;
+static gchar *metrics_path = NULL;
+static gint metrics_interval = 5;
+static PoseResultWriterParams results_params;
+static gint post_process_threads = 0;
+static gint batch_parallelism = 1;
+static gint async_post_process = 0;
+static gint async_queue_depth = 8;
+static gint max_in_flight = 16;
+static gboolean track_poses = FALSE;
+static gboolean headless = FALSE;
+static gboolean live = FALSE;
+static gint live_queue_size = 2;
+static gboolean pose_element = FALSE;
+static gdouble track_min_oks = 0.3;
+static PoseTrackerParams tracker_params;
+
+static GOptionEntry option_entries[] = {
+    {"skeleton", 0, 0, G_OPTION_ARG_STRING, &skeleton_name,
+     "Keypoint model of the network: 'body' (default, 18 parts) or 'hand' (21 parts)", "NAME"},
+    {"pgie-config", 0, 0, G_OPTION_ARG_FILENAME, &pgie_config_path,
+     "nvinfer configuration of the pose network (default deepstream_pose_estimation_config.txt)", "FILE"},
+    {"post-process-config", 0, 0, G_OPTION_ARG_FILENAME, &post_process_config_path,
+     "Post-processing parameters and quality governor (default " POST_PROCESS_CONFIG_DEFAULT " if present)", "FILE"},
+    {"peak-detector", 0, 0, G_OPTION_ARG_STRING, &peak_detector_name,
+     "Peak detector used on the confidence maps: 'window' (default), 'separable', 'compact' or 'pyramid'", "NAME"},
+    {"solver", 0, 0, G_OPTION_ARG_STRING, &solver_name,
+     "Assignment solver of the limbs: 'munkres' (default), 'lapjv' or 'greedy'", "NAME"},
+    {"prune-links", 0, 0, G_OPTION_ARG_NONE, &prune_links,
+     "Drop limb candidates scoring below the link threshold before the assignment", NULL},
+    {"paf-sampling", 0, 0, G_OPTION_ARG_STRING, &paf_sampling_name,
+     "How limb scores read the part affinity fields: 'nearest' (default) or 'bilinear'", "NAME"},
+    {"paf-sample-spacing", 0, 0, G_OPTION_ARG_DOUBLE, &paf_sample_spacing,
+     "Pixels between limb samples, 0 uses a fixed number of samples per limb (default)", "PX"},
+    {"full-scan-interval", 0, 0, G_OPTION_ARG_INT, &full_scan_interval,
+     "Search peaks only around the previous frame's people, with a full scan every N frames, 0 always scans in full (default)", "N"},
+    {"search-radius", 0, 0, G_OPTION_ARG_INT, &search_radius,
+     "Cells searched around every previous peak by the incremental peak search (default 3)", "N"},
+    {"search-energy-change", 0, 0, G_OPTION_ARG_DOUBLE, &search_energy_change,
+     "Relative change of a channel's region energy that forces a full scan (default 0.3)", "F"},
+    {"cmap-int8-scale", 0, 0, G_OPTION_ARG_DOUBLE, &cmap_int8_scale,
+     "Value of one quantization step of an INT8 cmap output (default 1/127)", "F"},
+    {"paf-int8-scale", 0, 0, G_OPTION_ARG_DOUBLE, &paf_int8_scale,
+     "Value of one quantization step of an INT8 paf output (default 1/127)", "F"},
+    {"post-process-threads", 0, 0, G_OPTION_ARG_INT, &post_process_threads,
+     "Extra threads running the post-processing of a frame, 0 runs it on the streaming thread (default)", "N"},
+    {"batch-parallelism", 0, 0, G_OPTION_ARG_INT, &batch_parallelism,
+     "Maximum number of frames of a batch post-processed concurrently (default 1)", "N"},
+    {"async-post-process", 0, 0, G_OPTION_ARG_INT, &async_post_process,
+     "Post-process on N worker threads and attach the results downstream, 0 runs inline (default)", "N"},
+    {"async-queue-depth", 0, 0, G_OPTION_ARG_INT, &async_queue_depth,
+     "Buffers held by the queue before the attach pad in asynchronous mode (default 8)", "N"},
+    {"max-in-flight", 0, 0, G_OPTION_ARG_INT, &max_in_flight,
+     "Frames submitted but not yet attached before the inference pad blocks (default 16)", "N"},
+    {"track", 0, 0, G_OPTION_ARG_NONE, &track_poses,
+     "Give every person a track id that persists across the frames of its source", NULL},
+    {"track-max-missed", 0, 0, G_OPTION_ARG_INT, &tracker_params.max_missed,
+     "Frames a track survives without a matching pose (default 15)", "N"},
+    {"track-min-oks", 0, 0, G_OPTION_ARG_DOUBLE, &track_min_oks,
+     "Keypoint similarity a pose needs to continue a track (default 0.3)", "OKS"},
+    {"headless", 0, 0, G_OPTION_ARG_NONE, &headless,
+     "Analytics only: end the pipeline in a fakesink after the post-processing, without drawing, "
+     "encoding or an output path", NULL},
+    {"live", 0, 0, G_OPTION_ARG_NONE, &live,
+     "Low-latency mode for live sources: adaptive batch timeout, leaky queues and glass-to-pose latency", NULL},
+    {"live-queue-size", 0, 0, G_OPTION_ARG_INT, &live_queue_size,
+     "Buffers a leaky queue of the live mode holds before dropping the oldest (default 2)", "N"},
+    {"pose-element", 0, 0, G_OPTION_ARG_NONE, &pose_element,
+     "Post-process in the nvdsposeparse element behind a queue instead of in a pad probe of nvinfer", NULL},
+    {"muxer-width", 0, 0, G_OPTION_ARG_INT, &muxer_width,
+     "Width of the batched frames, every source is scaled to it (default 1920)", "PX"},
+    {"muxer-height", 0, 0, G_OPTION_ARG_INT, &muxer_height,
+     "Height of the batched frames, every source is scaled to it (default 1080)", "PX"},
+    {"capture-tensors", 0, 0, G_OPTION_ARG_FILENAME, &capture_tensors_path,
+     "Append the cmap/paf outputs of every frame to FILE for offline replay", "FILE"},
+    {"metrics", 0, 0, G_OPTION_ARG_FILENAME, &metrics_path,
+     "Record per-stage latency histograms and counters and dump them to FILE in the Prometheus text format", "FILE"},
+    {"metrics-interval", 0, 0, G_OPTION_ARG_INT, &metrics_interval,
+     "Seconds between two metrics dumps (default 5)", "S"},
+    {"results", 0, 0, G_OPTION_ARG_FILENAME, &results_path,
+     "Append the poses of every frame to FILE as JSON Lines", "FILE"},
+    {"results-max-bytes", 0, 0, G_OPTION_ARG_INT64, &results_params.max_file_bytes,
+     "Size at which the results file is rotated, 0 never rotates (default 64 MiB)", "BYTES"},
+    {"results-max-files", 0, 0, G_OPTION_ARG_INT, &results_params.max_files,
+     "Rotated results files kept as FILE.1 to FILE.N (default 8)", "N"},
+    {"results-fsync-interval", 0, 0, G_OPTION_ARG_INT, &results_params.fsync_interval_ms,
+     "Longest time written results stay unsynced to disk (default 1000)", "MS"},
+    {NULL}};
+
+/*Method to parse information returned from the model*/
+template <class Skeleton>
+int
+parse_objects_from_tensor_meta(NvDsInferTensorMeta *tensor_meta, PostProcessWorkspace &workspace,
+                               PeakSearchState *search_state, const PostProcessParams &params)
+{
+  TensorFormat cmap_format, paf_format;
+  char message[160];
+  TensorCheck check = check_tensor_meta<Skeleton>(tensor_meta, cmap_format, paf_format, message, sizeof(message));
+  if (check != TENSOR_CHECK_OK)
+  {
+    /* Once per kind of problem, every frame of the model would repeat it */
+    static std::atomic<int> reported(0);
+    if (!(reported.fetch_or(1 << check) & (1 << check)))
+      g_printerr("%s\n", message);
+    workspace.num_objects = 0;
+    return 0;
+  }
+  cmap_format.int8_scale = cmap_int8_scale;
+  paf_format.int8_scale = paf_int8_scale;
 
   void *cmap_data = tensor_meta->out_buf_ptrs_host[0];
   NvDsInferDims &cmap_dims = tensor_meta->output_layers_info[0].inferDims;
   void *paf_data = tensor_meta->out_buf_ptrs_host[1];
   NvDsInferDims &paf_dims = tensor_meta->output_layers_info[1].inferDims;
 
-  /* Finding peaks within a given window */
-  find_peaks(counts, peaks, cmap_data, cmap_dims, threshold, window_size, max_num_parts);
-  /* Non-Maximum Suppression */
-  Vec3D<float> refined_peaks = refine_peaks(counts, peaks, cmap_data, cmap_dims, window_size);
-  /* Create a Bipartite graph to assign detected body-parts to a unique person in the frame */
-  Vec3D<float> score_graph = paf_score_graph(paf_data, paf_dims, topology, counts, refined_peaks, num_integral_samples);
-  /* Assign weights to all edges in the bipartite graph generated */
-  Vec3D<int> connections = assignment(score_graph, topology, counts, link_threshold, max_num_parts);
-  /* Connecting all the Body Parts and Forming a Human Skeleton */
-  Vec2D<int> objects = connect_parts(connections, topology, counts, max_num_objects);
-  return {objects, refined_peaks};
+  /* The governor swaps in cheaper parameters while frames exceed the latency budget */
+  int level = pose_governor.isEnabled() ? pose_governor.currentLevel() : 0;
+  const PostProcessParams &frame_params = pose_governor.isEnabled() ? pose_governor.current() : params;
+  workspace.reserve(Skeleton::NUM_PARTS, Skeleton::NUM_LINKS, cmap_dims.d[1], cmap_dims.d[2],
+                    frame_params.max_num_parts, frame_params.max_num_objects);
+
+  TaskScheduler *scheduler = post_process_threads > 0 ? pose_scheduler : NULL;
+  gint64 start = g_get_monotonic_time();
+  int num_objects = run_post_process<Skeleton>(workspace, scheduler, cmap_data, cmap_dims,
+                                               paf_data, paf_dims, frame_params, search_state,
+                                               cmap_format, paf_format);
+  if (pose_governor.isEnabled() &&
+      pose_governor.report(g_get_monotonic_time() - start) != level)
+  {
+    pose_metrics().setGovernorLevel(pose_governor.currentLevel(), pose_governor.levelChanges());
+  }
+  return num_objects;
 }
 
-/* MetaData to handle drawing onto the on-screen-display */
+template <class Skeleton>
 static void
-create_display_meta(Vec2D<int> &objects, Vec3D<float> &normalized_peaks, NvDsFrameMeta *frame_meta, int frame_width, int frame_height)
+run_batch_frames_task(Task *task)
 {
-  int K = topology.size();
-  int count = objects.size();
-  NvDsBatchMeta *bmeta = frame_meta->base_meta.batch_meta;
-  NvDsDisplayMeta *dmeta = nvds_acquire_display_meta_from_pool(bmeta);
-  nvds_add_display_meta_to_frame(frame_meta, dmeta);
-
-  for (auto &object : objects)
+  int num_frames = batch_frames.size();
+  for (int i = batch_next_frame++; i < num_frames; i = batch_next_frame++)
   {
-    int C = object.size();
-    for (int j = 0; j < C; j++)
-    {
-      int k = object[j];
-      if (k >= 0)
-      {
-        auto &peak = normalized_peaks[j][k];
-        int x = peak[1] * MUXER_OUTPUT_WIDTH;
-        int y = peak[0] * MUXER_OUTPUT_HEIGHT;
-        if (dmeta->num_circles == MAX_ELEMENTS_IN_DISPLAY_META)
-        {
-          dmeta = nvds_acquire_display_meta_from_pool(bmeta);
-          nvds_add_display_meta_to_frame(frame_meta, dmeta);
-        }
-        NvOSD_CircleParams &cparams = dmeta->circle_params[dmeta->num_circles];
-        cparams.xc = x;
-        cparams.yc = y;
-        cparams.radius = 8;
-        cparams.circle_color = NvOSD_ColorParams{244, 67, 54, 1};
-        cparams.has_bg_color = 1;
-        cparams.bg_color = NvOSD_ColorParams{0, 255, 0, 1};
-        dmeta->num_circles++;
-      }
-    }
+    BatchFrame &frame = batch_frames[i];
+    parse_objects_from_tensor_meta<Skeleton>(frame.tensor_meta, *frame.workspace,
+                                             frame.search_state, pose_params);
+  }
+}
 
-    for (int k = 0; k < K; k++)
-    {
-      int c_a = topology[k][2];
-      int c_b = topology[k][3];
-      if (object[c_a] >= 0 && object[c_b] >= 0)
-      {
-        auto &peak0 = normalized_peaks[c_a][object[c_a]];
-        auto &peak1 = normalized_peaks[c_b][object[c_b]];
-        int x0 = peak0[1] * MUXER_OUTPUT_WIDTH;
-        int y0 = peak0[0] * MUXER_OUTPUT_HEIGHT;
-        int x1 = peak1[1] * MUXER_OUTPUT_WIDTH;
-        int y1 = peak1[0] * MUXER_OUTPUT_HEIGHT;
-        if (dmeta->num_lines == MAX_ELEMENTS_IN_DISPLAY_META)
-        {
-          dmeta = nvds_acquire_display_meta_from_pool(bmeta);
-          nvds_add_display_meta_to_frame(frame_meta, dmeta);
-        }
-        NvOSD_LineParams &lparams = dmeta->line_params[dmeta->num_lines];
-        lparams.x1 = x0;
-        lparams.x2 = x1;
-        lparams.y1 = y0;
-        lparams.y2 = y1;
-        lparams.line_width = 3;
-        lparams.line_color = NvOSD_ColorParams{0, 255, 0, 1};
-        dmeta->num_lines++;
-      }
-    }
+static SourceState *
+source_state(guint source_id)
+{
+  return source_id < source_states.size() ? &source_states[source_id] : NULL;
+}
+
+/* Queues tensor output 'output' of a frame for the post-processing of the current batch,
+   with the workspace of its batch slot and the peak search state its source keeps for that
+   output. Asynchronous jobs bring their own workspace; the search state stays with the
+   source, whose frames are processed in order by a single worker. */
+static void
+add_batch_frame(NvDsFrameMeta *frame_meta, NvDsInferTensorMeta *tensor_meta, int output)
+{
+  SourceState *state = source_state(frame_meta->source_id);
+  if (!state)
+    return;
+  if (output == (int)state->peak_searches.size())
+    state->peak_searches.emplace_back(new PeakSearchState());
+  PeakSearchState *search_state = state->peak_searches[output].get();
+  if (pose_async)
+  {
+    batch_frames.push_back({frame_meta, tensor_meta, NULL, search_state});
+    return;
   }
+  size_t slot = batch_frames.size();
+  if (slot == batch_workspaces.size())
+    batch_workspaces.emplace_back(new PostProcessWorkspace());
+  batch_frames.push_back({frame_meta, tensor_meta, batch_workspaces[slot].get(), search_state});
+}
+
+/* MetaData to handle drawing onto the on-screen-display, built on the streaming thread */
+template <class Skeleton>
+static void
+create_display_meta(PostProcessWorkspace &workspace, NvDsFrameMeta *frame_meta, int frame_width, int frame_height)
+{
+  ScopedStageTimer timer(METRIC_CREATE_DISPLAY_META);
+  static PoseDisplayBuilder<Skeleton> builder;
+  builder.build(workspace, frame_meta, frame_width, frame_height);
+}
+
+/* Nanoseconds from 'pts' to now on the pipeline clock, -1 when unknown. Live sources
+   timestamp their buffers with the running time at capture. */
+static gint64
+glass_to_pose_latency(guint64 pts)
+{
+  if (!GST_CLOCK_TIME_IS_VALID(pts))
+    return -1;
+  GstClock *clock = gst_element_get_clock(live_pipeline);
+  if (!clock)
+    return -1;
+  GstClockTime now = gst_clock_get_time(clock) - gst_element_get_base_time(live_pipeline);
+  gst_object_unref(clock);
+  return now > pts ? (gint64)(now - pts) : 0;
+}
+
+/* Follows up on the attached poses of a frame: latency, track ids and result files */
+static void
+handle_frame_poses(PoseMeta *pose_meta, NvDsFrameMeta *frame_meta)
+{
+  gint64 latency = live ? glass_to_pose_latency(frame_meta->buf_pts) : -1;
+  if (latency >= 0 && pose_metrics().isEnabled())
+    pose_metrics().local().record(METRIC_GLASS_TO_POSE, latency);
+
+  SourceState *state = source_state(frame_meta->source_id);
+  if (track_poses && state)
+    state->tracker.update(*pose_meta);
+
+  if (pose_results.isOpen())
+    pose_results.write(pose_meta, frame_meta->source_id, frame_meta->frame_num, frame_meta->buf_pts, latency);
+}
+
+/* Attaches the results of a frame in the order its source produced them: the OSD
+   drawing and the poses, with their track ids when tracking */
+template <class Skeleton>
+static void
+attach_frame_results(PostProcessWorkspace &workspace, NvDsFrameMeta *frame_meta)
+{
+  /* The OSD draws on the batched frame, which nvstreammux scaled to the muxer resolution */
+  if (!headless)
+    create_display_meta<Skeleton>(workspace, frame_meta, muxer_width, muxer_height);
+  handle_frame_poses(attach_pose_meta<Skeleton>(workspace, frame_meta), frame_meta);
 }
 
 /* pgie_src_pad_buffer_probe  will extract metadata received from pgie
  * and update params for drawing rectangle, object information etc. */
+template <class Skeleton>
 static GstPadProbeReturn
 pgie_src_pad_buffer_probe(GstPad *pad, GstPadProbeInfo *info,
                           gpointer u_data)
 {
+  ScopedStageTimer timer(METRIC_PGIE_PROBE);
   gchar *msg = NULL;
   GstBuffer *buf = (GstBuffer *)info->data;
   NvDsMetaList *l_frame = NULL;
@@ -154,10 +377,13 @@ pgie_src_pad_buffer_probe(GstPad *pad, GstPadProbeInfo *info,
   NvDsMetaList *l_user = NULL;
   NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta(buf);
 
+  batch_frames.clear();
+
   for (l_frame = batch_meta->frame_meta_list; l_frame != NULL;
        l_frame = l_frame->next)
   {
     NvDsFrameMeta *frame_meta = (NvDsFrameMeta *)(l_frame->data);
+    int outputs = 0;
 
     for (l_user = frame_meta->frame_user_meta_list; l_user != NULL;
          l_user = l_user->next)
@@ -167,10 +393,7 @@ pgie_src_pad_buffer_probe(GstPad *pad, GstPadProbeInfo *info,
       {
         NvDsInferTensorMeta *tensor_meta =
             (NvDsInferTensorMeta *)user_meta->user_meta_data;
-        Vec2D<int> objects;
-        Vec3D<float> normalized_peaks;
-        tie(objects, normalized_peaks) = parse_objects_from_tensor_meta(tensor_meta);
-        create_display_meta(objects, normalized_peaks, frame_meta, frame_meta->source_frame_width, frame_meta->source_frame_height);
+        add_batch_frame(frame_meta, tensor_meta, outputs++);
       }
     }
 
@@ -186,19 +409,98 @@ pgie_src_pad_buffer_probe(GstPad *pad, GstPadProbeInfo *info,
         {
           NvDsInferTensorMeta *tensor_meta =
               (NvDsInferTensorMeta *)user_meta->user_meta_data;
-          Vec2D<int> objects;
-          Vec3D<float> normalized_peaks;
-          tie(objects, normalized_peaks) = parse_objects_from_tensor_meta(tensor_meta);
-          create_display_meta(objects, normalized_peaks, frame_meta, frame_meta->source_frame_width, frame_meta->source_frame_height);
+          add_batch_frame(frame_meta, tensor_meta, outputs++);
         }
       }
     }
   }
+
+  if (tensor_capture.isOpen())
+  {
+    for (BatchFrame &frame : batch_frames)
+    {
+      tensor_capture.write(frame.tensor_meta, frame.frame_meta->source_id,
+                           frame.frame_meta->frame_num, frame.frame_meta->buf_pts);
+    }
+  }
+
+  /* Hand the frames to the workers, the attach probe picks the results up */
+  if (pose_async)
+  {
+    for (BatchFrame &frame : batch_frames)
+      pose_async->submit(buf, frame.frame_meta, frame.tensor_meta, frame.search_state);
+    return GST_PAD_PROBE_OK;
+  }
+
+  /* Parse the frames of the batch concurrently, unless a source repeats in it */
+  batch_next_frame = 0;
+  if (pose_scheduler && batch_parallelism > 1 && batch_frames.size() > 1 &&
+      !frames_share_search_state(batch_frames))
+    pose_scheduler->run(batch_graph);
+  else
+    run_batch_frames_task<Skeleton>(NULL);
+
+  /* Meta pools are not thread-safe, attach the results back on the streaming thread */
+  for (BatchFrame &frame : batch_frames)
+  {
+    attach_frame_results<Skeleton>(*frame.workspace, frame.frame_meta);
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+/* attach_pad_buffer_probe waits for the asynchronous post-processing of the
+ * buffer's frames and attaches their metadata before the OSD draws them */
+template <class Skeleton>
+static GstPadProbeReturn
+attach_pad_buffer_probe(GstPad *pad, GstPadProbeInfo *info,
+                        gpointer u_data)
+{
+  ScopedStageTimer timer(METRIC_ATTACH_PROBE);
+  GstBuffer *buf = (GstBuffer *)info->data;
+  PostProcessJob *job;
+
+  while ((job = pose_async->next(buf)) != NULL)
+  {
+    attach_frame_results<Skeleton>(job->workspace, job->frame_meta);
+    pose_async->release(job);
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+/* attach_pad_event_probe drops the jobs of buffers that will never reach the
+ * attach pad: those flushed by a seek, and any left over at the end of stream */
+static GstPadProbeReturn
+attach_pad_event_probe(GstPad *pad, GstPadProbeInfo *info,
+                       gpointer u_data)
+{
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+  if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP || GST_EVENT_TYPE(event) == GST_EVENT_EOS)
+    pose_async->flush();
+  return GST_PAD_PROBE_OK;
+}
+
+/* pose_parse_src_pad_buffer_probe picks up the poses the nvdsposeparse element
+ * attached to the buffer's frames */
+static GstPadProbeReturn
+pose_parse_src_pad_buffer_probe(GstPad *pad, GstPadProbeInfo *info,
+                                gpointer u_data)
+{
+  NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta((GstBuffer *)info->data);
+  if (!batch_meta)
+    return GST_PAD_PROBE_OK;
+  for (NvDsMetaList *l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next)
+  {
+    NvDsFrameMeta *frame_meta = (NvDsFrameMeta *)l_frame->data;
+    PoseMeta *pose_meta = find_pose_meta(frame_meta);
+    if (pose_meta)
+      handle_frame_poses(pose_meta, frame_meta);
+  }
   return GST_PAD_PROBE_OK;
 }
 
 /* osd_sink_pad_buffer_probe  will extract metadata received from OSD
- * and update params for drawing rectangle, object information etc. */
+ * and update params for drawing rectangle, object information etc.
+ * With several sources it runs before the tiler, which still sees every frame. */
 static GstPadProbeReturn
 osd_sink_pad_buffer_probe(GstPad *pad, GstPadProbeInfo *info,
                           gpointer u_data)
@@ -216,7 +518,10 @@ osd_sink_pad_buffer_probe(GstPad *pad, GstPadProbeInfo *info,
        l_frame = l_frame->next)
   {
     NvDsFrameMeta *frame_meta = (NvDsFrameMeta *)(l_frame->data);
+    SourceState *state = source_state(frame_meta->source_id);
     int offset = 0;
+    if (!state)
+      continue;
     for (l_obj = frame_meta->obj_meta_list; l_obj != NULL; l_obj = l_obj->next)
     {
       obj_meta = (NvDsObjectMeta *)(l_obj->data);
@@ -227,7 +532,11 @@ osd_sink_pad_buffer_probe(GstPad *pad, GstPadProbeInfo *info,
     NvOSD_TextParams *txt_params = &display_meta->text_params[0];
     display_meta->num_labels = 1;
     txt_params->display_text = (char *)g_malloc0(MAX_DISPLAY_LEN);
-    offset = snprintf(txt_params->display_text, MAX_DISPLAY_LEN, "Frame Number =  %d", frame_number);
+    if (source_states.size() > 1)
+      offset = snprintf(txt_params->display_text, MAX_DISPLAY_LEN, "Source %u Frame Number =  %d",
+                        frame_meta->source_id, state->frame_number);
+    else
+      offset = snprintf(txt_params->display_text, MAX_DISPLAY_LEN, "Frame Number =  %d", state->frame_number);
     offset = snprintf(txt_params->display_text + offset, MAX_DISPLAY_LEN, "");
 
     txt_params->x_offset = 10;
@@ -247,8 +556,8 @@ osd_sink_pad_buffer_probe(GstPad *pad, GstPadProbeInfo *info,
     txt_params->text_bg_clr.alpha = 1.0;
 
     nvds_add_display_meta_to_frame(frame_meta, display_meta);
+    state->frame_number++;
   }
-  frame_number++;
   return GST_PAD_PROBE_OK;
 }
 
@@ -329,29 +638,422 @@ done:
   return ret;
 }
 
+/* Links 'pgie' to 'next' through the post-processing queue and element, either may be NULL */
+static gboolean
+link_post_process(GstElement *pgie, GstElement *queue, GstElement *pose_parse, GstElement *next)
+{
+  GstElement *chain[] = {pgie, queue, pose_parse, next};
+  GstElement *prev = pgie;
+  for (guint i = 1; i < G_N_ELEMENTS(chain); i++)
+  {
+    if (!chain[i])
+      continue;
+    if (!gst_element_link(prev, chain[i]))
+      return FALSE;
+    prev = chain[i];
+  }
+  return TRUE;
+}
+
+/* Links the decoded video pad of a uridecodebin to the muxer sink pad given as 'data' */
+static void
+uridecodebin_pad_added(GstElement *decodebin, GstPad *pad, gpointer data)
+{
+  GstPad *mux_pad = (GstPad *)data;
+  GstCaps *caps = gst_pad_get_current_caps(pad);
+  if (!caps)
+    caps = gst_pad_query_caps(pad, NULL);
+
+  const gchar *name = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+  if (g_str_has_prefix(name, "video/") && !gst_pad_is_linked(mux_pad))
+  {
+    /* nvstreammux only batches NVMM buffers, i.e. streams decoded by nvv4l2decoder */
+    if (!gst_caps_features_contains(gst_caps_get_features(caps, 0), "memory:NVMM"))
+      g_printerr("'%s' did not pick an NVIDIA decoder\n", GST_ELEMENT_NAME(decodebin));
+    else if (gst_pad_link(pad, mux_pad) != GST_PAD_LINK_OK)
+      g_printerr("Failed to link '%s' to stream muxer\n", GST_ELEMENT_NAME(decodebin));
+  }
+  gst_caps_unref(caps);
+}
+
+/* Reads the [post-process] and [governor] groups of the post-processing config at 'path'.
+   Keys left out keep their current values. */
+static gboolean
+load_post_process_config(const gchar *path, PostProcessParams &params, GovernorParams &governor)
+{
+  GError *error = NULL;
+  GKeyFile *key_file = g_key_file_new();
+  gboolean ok = g_key_file_load_from_file(key_file, path, G_KEY_FILE_NONE, &error);
+
+  auto get_double = [&](const gchar *group, const gchar *key, gdouble &value) {
+    if (!ok || !g_key_file_has_key(key_file, group, key, NULL))
+      return;
+    gdouble v = g_key_file_get_double(key_file, group, key, &error);
+    ok = error == NULL;
+    if (ok)
+      value = v;
+  };
+  auto get_integer = [&](const gchar *group, const gchar *key, gint &value) {
+    if (!ok || !g_key_file_has_key(key_file, group, key, NULL))
+      return;
+    gint v = g_key_file_get_integer(key_file, group, key, &error);
+    ok = error == NULL;
+    if (ok)
+      value = v;
+  };
+
+  gdouble threshold = params.threshold;
+  gdouble link_threshold = params.link_threshold;
+  gint window_size = params.window_size;
+  gint max_num_parts = params.max_num_parts;
+  gint num_integral_samples = params.num_integral_samples;
+  gint max_num_objects = params.max_num_objects;
+  get_double("post-process", "threshold", threshold);
+  get_integer("post-process", "window-size", window_size);
+  get_integer("post-process", "max-num-parts", max_num_parts);
+  get_integer("post-process", "num-integral-samples", num_integral_samples);
+  get_double("post-process", "link-threshold", link_threshold);
+  get_integer("post-process", "max-num-objects", max_num_objects);
+
+  gint enable = governor.enabled;
+  get_integer("governor", "enable", enable);
+  get_double("governor", "budget-ms", governor.budget_ms);
+  get_integer("governor", "degrade-after", governor.degrade_after);
+  get_integer("governor", "restore-after", governor.restore_after);
+  get_double("governor", "restore-headroom", governor.restore_headroom);
+
+  if (!ok)
+  {
+    g_printerr("Failed to read post-processing config '%s': %s\n", path, error->message);
+    g_error_free(error);
+    g_key_file_free(key_file);
+    return FALSE;
+  }
+  g_key_file_free(key_file);
+
+  if (threshold <= 0.0 || threshold >= 1.0 || link_threshold < 0.0 || window_size < 1 ||
+      window_size % 2 == 0 || max_num_parts < 1 || num_integral_samples < 2 || max_num_objects < 1)
+  {
+    g_printerr("'%s': the peak threshold must lie in (0, 1) and the link threshold must not be negative, "
+               "the window size must be odd and the part, sample and object counts positive\n", path);
+    return FALSE;
+  }
+  if (governor.budget_ms <= 0.0 || governor.degrade_after < 1 || governor.restore_after < 1 ||
+      governor.restore_headroom <= 0.0 || governor.restore_headroom > 1.0)
+  {
+    g_printerr("'%s': the governor needs a positive budget and frame counts, and a headroom in (0, 1]\n",
+               path);
+    return FALSE;
+  }
+
+  params.threshold = threshold;
+  params.link_threshold = link_threshold;
+  params.window_size = window_size;
+  params.max_num_parts = max_num_parts;
+  params.num_integral_samples = num_integral_samples;
+  params.max_num_objects = max_num_objects;
+  governor.enabled = enable != 0;
+  return TRUE;
+}
+
+/* Writes the metrics file, called periodically from the main loop */
+static gboolean
+dump_metrics(gpointer data)
+{
+  if (!pose_metrics().dump(metrics_path))
+    g_printerr("Failed to write metrics to '%s'\n", metrics_path);
+  return TRUE;
+}
+
+/* muxer_sink_pad_buffer_probe measures the frame interval of a live source from the
+ * PTS of the buffers entering its muxer pad */
+static GstPadProbeReturn
+muxer_sink_pad_buffer_probe(GstPad *pad, GstPadProbeInfo *info,
+                            gpointer u_data)
+{
+  GstBuffer *buf = (GstBuffer *)info->data;
+  if (GST_BUFFER_PTS_IS_VALID(buf))
+    batch_timeout.observe(GPOINTER_TO_UINT(u_data), GST_BUFFER_PTS(buf));
+  return GST_PAD_PROBE_OK;
+}
+
+/* Moves the muxer batch timeout to the measured source frame rates, called periodically
+   from the main loop. Small changes are ignored so the property is not set every time. */
+static gboolean
+update_batch_timeout(gpointer data)
+{
+  GstElement *streammux = (GstElement *)data;
+  gint64 timeout = batch_timeout.timeout();
+  if (timeout && ABS(timeout - batch_timeout_usec) * 10 > batch_timeout_usec)
+  {
+    batch_timeout_usec = timeout;
+    g_object_set(G_OBJECT(streammux), "batched-push-timeout", (gint)timeout, NULL);
+  }
+  return TRUE;
+}
+
+/* Adds the decoding branch of input 'index' to the pipeline and feeds it to muxer pad
+   'sink_<index>', so its frames carry source_id 'index'. URIs are decoded by uridecodebin,
+   plain paths are read as elementary H.264 streams. */
+static gboolean
+add_source(GstElement *pipeline, GstElement *streammux, guint index, const gchar *input)
+{
+  gchar name[32];
+  GstPad *mux_pad = NULL;
+  GstPad *decoder_pad = NULL;
+  GstElement *source = NULL, *h264parser = NULL, *decoder = NULL;
+
+  g_snprintf(name, sizeof(name), "sink_%u", index);
+  mux_pad = gst_element_get_request_pad(streammux, name);
+  if (!mux_pad)
+  {
+    g_printerr("Streammux request sink pad failed. Exiting.\n");
+    return FALSE;
+  }
+  if (live)
+    gst_pad_add_probe(mux_pad, GST_PAD_PROBE_TYPE_BUFFER, muxer_sink_pad_buffer_probe,
+                      GUINT_TO_POINTER(index), NULL);
+
+  if (gst_uri_is_valid(input))
+  {
+    g_snprintf(name, sizeof(name), "uri-decode-bin-%u", index);
+    source = gst_element_factory_make("uridecodebin", name);
+    if (!source)
+    {
+      g_printerr("One element could not be created. Exiting.\n");
+      gst_object_unref(mux_pad);
+      return FALSE;
+    }
+    g_object_set(G_OBJECT(source), "uri", input, NULL);
+
+    /* The signal handler owns the muxer pad from here on */
+    g_signal_connect_data(source, "pad-added", G_CALLBACK(uridecodebin_pad_added), mux_pad,
+                          (GClosureNotify)gst_object_unref, (GConnectFlags)0);
+    gst_bin_add(GST_BIN(pipeline), source);
+    return TRUE;
+  }
+
+  g_snprintf(name, sizeof(name), "file-source-%u", index);
+  source = gst_element_factory_make("filesrc", name);
+  g_snprintf(name, sizeof(name), "h264-parser-%u", index);
+  h264parser = gst_element_factory_make("h264parse", name);
+  g_snprintf(name, sizeof(name), "nvv4l2-decoder-%u", index);
+  decoder = gst_element_factory_make("nvv4l2decoder", name);
+  if (!source || !h264parser || !decoder)
+  {
+    g_printerr("One element could not be created. Exiting.\n");
+    gst_object_unref(mux_pad);
+    return FALSE;
+  }
+  g_object_set(G_OBJECT(source), "location", input, NULL);
+  gst_bin_add_many(GST_BIN(pipeline), source, h264parser, decoder, NULL);
+
+  if (!gst_element_link_many(source, h264parser, decoder, NULL))
+  {
+    g_printerr("Elements could not be linked: 1. Exiting.\n");
+    gst_object_unref(mux_pad);
+    return FALSE;
+  }
+
+  decoder_pad = gst_element_get_static_pad(decoder, "src");
+  if (!decoder_pad || gst_pad_link(decoder_pad, mux_pad) != GST_PAD_LINK_OK)
+  {
+    g_printerr("Failed to link decoder to stream muxer. Exiting.\n");
+    if (decoder_pad)
+      gst_object_unref(decoder_pad);
+    gst_object_unref(mux_pad);
+    return FALSE;
+  }
+  gst_object_unref(decoder_pad);
+  gst_object_unref(mux_pad);
+  return TRUE;
+}
+
 int main(int argc, char *argv[])
 {
   GMainLoop *loop = NULL;
   GstCaps *caps = NULL;
-  GstElement *pipeline = NULL, *source = NULL, *h264parser = NULL,
-             *decoder = NULL, *streammux = NULL, *sink = NULL, *pgie = NULL, *nvvidconv = NULL, *nvosd = NULL,
+  GstElement *pipeline = NULL, *streammux = NULL, *tiler = NULL, *sink = NULL, *pgie = NULL, *nvvidconv = NULL, *nvosd = NULL,
              *nvvideoconvert = NULL, *tee = NULL, *h264encoder = NULL, *cap_filter = NULL, *filesink = NULL, *queue = NULL, *qtmux = NULL, *h264parser1 = NULL, *nvsink = NULL;
 
 /* Add a transform element for Jetson*/
 #ifdef PLATFORM_TEGRA
   GstElement *transform = NULL;
 #endif
+  GstElement *post_process_queue = NULL, *fakesink = NULL, *inference_queue = NULL, *pose_parse = NULL;
   GstBus *bus = NULL;
   guint bus_watch_id;
   GstPad *osd_sink_pad = NULL;
 
-  /* Check input arguments */
-  if (argc != 3)
+  GOptionContext *option_context = NULL;
+  GError *error = NULL;
+
+  /* Parse options, leaving the positional arguments in argv */
+  option_context = g_option_context_new("<filename-or-uri> [<filename-or-uri>...] <output-path>");
+  g_option_context_add_main_entries(option_context, option_entries, NULL);
+  g_option_context_add_group(option_context, gst_init_get_option_group());
+  if (!g_option_context_parse(option_context, &argc, &argv, &error))
+  {
+    g_printerr("%s\n", error->message);
+    g_error_free(error);
+    return -1;
+  }
+  g_option_context_free(option_context);
+
+  if (peak_detector_name && !peak_detector_from_string(peak_detector_name, pose_params.peak_detector))
+  {
+    g_printerr("Unknown peak detector '%s'\n", peak_detector_name);
+    return -1;
+  }
+  if (solver_name && !assignment_solver_from_string(solver_name, pose_params.solver))
+  {
+    g_printerr("Unknown assignment solver '%s'\n", solver_name);
+    return -1;
+  }
+  pose_params.prune_links = prune_links;
+  SkeletonType skeleton = SKELETON_BODY;
+  if (skeleton_name && !skeleton_from_string(skeleton_name, skeleton))
+  {
+    g_printerr("Unknown skeleton '%s'\n", skeleton_name);
+    return -1;
+  }
+  if (paf_sampling_name && !paf_sampling_from_string(paf_sampling_name, pose_params.paf_sampling))
+  {
+    g_printerr("Unknown PAF sampling '%s'\n", paf_sampling_name);
+    return -1;
+  }
+  if (paf_sample_spacing < 0.0)
+  {
+    g_printerr("PAF sample spacing must not be negative\n");
+    return -1;
+  }
+  pose_params.paf_sample_spacing = paf_sample_spacing;
+  if (full_scan_interval < 0 || search_radius < 0 || search_energy_change < 0.0)
+  {
+    g_printerr("The incremental peak search needs a non-negative interval, radius and energy change\n");
+    return -1;
+  }
+  pose_params.full_scan_interval = full_scan_interval;
+  pose_params.search_radius = search_radius;
+  pose_params.search_energy_change = search_energy_change;
+  if (cmap_int8_scale <= 0.0 || paf_int8_scale <= 0.0)
+  {
+    g_printerr("INT8 output scales must be positive\n");
+    return -1;
+  }
+
+  GovernorParams governor_params;
+  if (!post_process_config_path && g_file_test(POST_PROCESS_CONFIG_DEFAULT, G_FILE_TEST_EXISTS))
+    post_process_config_path = g_strdup(POST_PROCESS_CONFIG_DEFAULT);
+  if (post_process_config_path &&
+      !load_post_process_config(post_process_config_path, pose_params, governor_params))
+  {
+    return -1;
+  }
+
+  /* Check input arguments, a headless pipeline writes no video and takes no output path */
+  if (argc < (headless ? 2 : 3))
+  {
+    g_printerr("Usage: %s [OPTION...] <filename-or-uri> [<filename-or-uri>...] <output-path>\n"
+               "       %s --headless [OPTION...] <filename-or-uri> [<filename-or-uri>...]\n",
+               argv[0], argv[0]);
+    return -1;
+  }
+  if (muxer_width < 1 || muxer_height < 1)
+  {
+    g_printerr("Muxer resolution must be positive\n");
+    return -1;
+  }
+  if (live_queue_size < 1)
+  {
+    g_printerr("Live queues must hold at least one buffer\n");
+    return -1;
+  }
+
+  /* Every input is one source of the batch */
+  guint num_sources = headless ? argc - 1 : argc - 2;
+  if (tracker_params.max_missed < 0 || track_min_oks < 0.0 || track_min_oks >= 1.0)
+  {
+    g_printerr("Tracks need a non-negative miss count and a minimum OKS in [0, 1)\n");
+    return -1;
+  }
+  tracker_params.min_similarity = track_min_oks;
+  tracker_params.solver = pose_params.solver;
+  source_states.resize(num_sources);
+  if (live)
+    batch_timeout.reset(num_sources, LIVE_MIN_BATCH_TIMEOUT_USEC, LIVE_MAX_BATCH_TIMEOUT_USEC);
+  for (SourceState &state : source_states)
+    state.tracker = PoseTracker(tracker_params);
+
+  if (batch_parallelism < 1)
+    batch_parallelism = 1;
+  if (!pose_element && (post_process_threads > 0 || batch_parallelism > 1))
+    pose_scheduler = new TaskScheduler(MAX(post_process_threads, batch_parallelism - 1));
+
+  if (capture_tensors_path && !tensor_capture.open(capture_tensors_path))
   {
-    g_printerr("Usage: %s <filename> <output-path>\n", argv[0]);
+    g_printerr("Failed to open tensor capture '%s'\n", capture_tensors_path);
     return -1;
   }
 
+  if (metrics_path)
+  {
+    if (metrics_interval < 1)
+    {
+      g_printerr("Metrics interval must be at least one second\n");
+      return -1;
+    }
+    pose_metrics().enable();
+    if (skeleton == SKELETON_HAND)
+      pose_metrics().setPartNames(HandSkeleton::part_names, HandSkeleton::NUM_PARTS);
+    else
+      pose_metrics().setPartNames(BodySkeleton::part_names, BodySkeleton::NUM_PARTS);
+  }
+
+  if (governor_params.enabled)
+  {
+    pose_governor.configure(pose_params, governor_params);
+    pose_metrics().setGovernorLevel(0, 0);
+  }
+
+  if (results_params.max_file_bytes < 0 || results_params.max_files < 0 ||
+      results_params.fsync_interval_ms < 1)
+  {
+    g_printerr("Results need a non-negative rotation size and file count and a positive fsync interval\n");
+    return -1;
+  }
+  if (results_path && !pose_results.open(results_path, results_params))
+  {
+    g_printerr("Failed to open results file '%s'\n", results_path);
+    return -1;
+  }
+
+  if (async_post_process < 0 || async_queue_depth < 1 || max_in_flight < 1)
+  {
+    g_printerr("Asynchronous post-processing needs N >= 0 workers, a queue depth and in-flight limit >= 1\n");
+    return -1;
+  }
+  if (pose_element && async_post_process > 0)
+  {
+    g_printerr("The nvdsposeparse element post-processes on its own, drop --async-post-process\n");
+    return -1;
+  }
+  if (async_post_process > 0)
+  {
+    /* A whole batch is submitted before its buffer can reach the attach probe */
+    max_in_flight = MAX(max_in_flight, (gint)num_sources);
+    pose_async = new AsyncPostProcessor(
+        async_post_process, max_in_flight,
+        skeleton == SKELETON_HAND ? parse_objects_from_tensor_meta<HandSkeleton>
+                                  : parse_objects_from_tensor_meta<BodySkeleton>,
+        pose_params);
+  }
+
+  batch_graph.resize(batch_parallelism);
+  for (int i = 0; i < batch_parallelism; i++)
+    batch_graph.task(i).run = skeleton == SKELETON_HAND ? run_batch_frames_task<HandSkeleton>
+                                                        : run_batch_frames_task<BodySkeleton>;
+
   /* Standard GStreamer initialization */
   gst_init(&argc, &argv);
   loop = g_main_loop_new(NULL, FALSE);
@@ -360,17 +1062,8 @@ int main(int argc, char *argv[])
   /* Create Pipeline element that will form a connection of other elements */
   pipeline = gst_pipeline_new("deepstream-tensorrt-openpose-pipeline");
 
-  /* Source element for reading from the file */
-  source = gst_element_factory_make("filesrc", "file-source");
-
-  /* Since the data format in the input file is elementary h264 stream,
-   * we need a h264parser */
-  h264parser = gst_element_factory_make("h264parse", "h264-parser");
   h264parser1 = gst_element_factory_make("h264parse", "h264-parser1");
 
-  /* Use nvdec_h264 for hardware accelerated decode on GPU */
-  decoder = gst_element_factory_make("nvv4l2decoder", "nvv4l2-decoder");
-
   /* Create nvstreammux instance to form batches from one or more sources. */
   streammux = gst_element_factory_make("nvstreammux", "stream-muxer");
 
@@ -384,186 +1077,328 @@ int main(int argc, char *argv[])
    * behaviour of inferencing is set through config file */
   pgie = gst_element_factory_make("nvinfer", "primary-nvinference-engine");
 
-  /* Use convertor to convert from NV12 to RGBA as required by nvosd */
-  nvvidconv = gst_element_factory_make("nvvideoconvert", "nvvideo-converter");
-
-  queue = gst_element_factory_make("queue", "queue");
-  filesink = gst_element_factory_make("filesink", "filesink");
-  
-  /* Set output file location */
-  char *output_path = argv[2];
-  strcat(output_path,"Pose_Estimation.mp4");
-  g_object_set(G_OBJECT(filesink), "location", output_path, NULL);
-  
-  nvvideoconvert = gst_element_factory_make("nvvideoconvert", "nvvideo-converter1");
-  tee = gst_element_factory_make("tee", "TEE");
-  h264encoder = gst_element_factory_make("nvv4l2h264enc", "video-encoder");
-  cap_filter = gst_element_factory_make("capsfilter", "enc_caps_filter");
-  caps = gst_caps_from_string("video/x-raw(memory:NVMM), format=I420");
-  g_object_set(G_OBJECT(cap_filter), "caps", caps, NULL);
-  qtmux = gst_element_factory_make("qtmux", "muxer");
-
-  /* Create OSD to draw on the converted RGBA buffer */
-  nvosd = gst_element_factory_make("nvdsosd", "nv-onscreendisplay");
-
-  /* Finally render the osd output */
+  /* Decouples inference from the attach probe or the nvdsposeparse element so the
+   * post-processing can overlap it */
+  if (pose_async || pose_element)
+  {
+    post_process_queue = gst_element_factory_make("queue", "post-process-queue");
+    if (!post_process_queue)
+    {
+      g_printerr("One element could not be created. Exiting.\n");
+      return -1;
+    }
+    g_object_set(G_OBJECT(post_process_queue), "max-size-buffers", async_queue_depth,
+                 "max-size-bytes", 0, "max-size-time", (guint64)0, NULL);
+  }
+  if (pose_element)
+  {
+    pose_parse = gst_element_factory_make("nvdsposeparse", "pose-parser");
+    if (!pose_parse)
+    {
+      g_printerr("The nvdsposeparse element could not be created, build it with 'make plugin' "
+                 "and add its directory to GST_PLUGIN_PATH. Exiting.\n");
+      return -1;
+    }
+    g_object_set(G_OBJECT(pose_parse), "skeleton", skeleton == SKELETON_HAND ? "hand" : "body",
+                 "threshold", pose_params.threshold, "link-threshold", pose_params.link_threshold,
+                 "window-size", (guint)pose_params.window_size, "max-num-parts", (guint)pose_params.max_num_parts,
+                 "num-integral-samples", (guint)pose_params.num_integral_samples,
+                 "max-num-objects", (guint)pose_params.max_num_objects,
+                 "peak-detector", peak_detector_names[pose_params.peak_detector],
+                 "solver", assignment_solver_names[pose_params.solver], "prune-links", (gboolean)pose_params.prune_links,
+                 "cmap-int8-scale", cmap_int8_scale, "paf-int8-scale", paf_int8_scale,
+                 "threads", (guint)MAX(post_process_threads, 0), "batch-parallelism", (guint)batch_parallelism,
+                 "display", !headless, NULL);
+  }
+  if (headless)
+  {
+    /* Analytics only: the poses leave the pipeline as metadata and result files, the
+     * frames are dropped right after the post-processing */
+    fakesink = gst_element_factory_make("fakesink", "fakesink");
+    if (!pgie || !fakesink)
+    {
+      g_printerr("One element could not be created. Exiting.\n");
+      return -1;
+    }
+    g_object_set(G_OBJECT(fakesink), "sync", FALSE, "enable-last-sample", FALSE, NULL);
+  }
+  else
+  {
+    /* Use convertor to convert from NV12 to RGBA as required by nvosd */
+    nvvidconv = gst_element_factory_make("nvvideoconvert", "nvvideo-converter");
+
+    /* Composes the frames of all sources into one output frame */
+    if (num_sources > 1)
+    {
+      tiler = gst_element_factory_make("nvmultistreamtiler", "nvtiler");
+      if (!tiler)
+      {
+        g_printerr("One element could not be created. Exiting.\n");
+        return -1;
+      }
+      guint tiler_columns = (guint)ceil(sqrt((double)num_sources));
+      guint tiler_rows = (num_sources + tiler_columns - 1) / tiler_columns;
+      g_object_set(G_OBJECT(tiler), "rows", tiler_rows, "columns", tiler_columns,
+                   "width", muxer_width, "height", muxer_height, NULL);
+    }
+
+    queue = gst_element_factory_make("queue", "queue");
+    filesink = gst_element_factory_make("filesink", "filesink");
+
+    /* Set output file location */
+    char *output_path = argv[argc - 1];
+    strcat(output_path,"Pose_Estimation.mp4");
+    g_object_set(G_OBJECT(filesink), "location", output_path, NULL);
+
+    nvvideoconvert = gst_element_factory_make("nvvideoconvert", "nvvideo-converter1");
+    tee = gst_element_factory_make("tee", "TEE");
+    h264encoder = gst_element_factory_make("nvv4l2h264enc", "video-encoder");
+    cap_filter = gst_element_factory_make("capsfilter", "enc_caps_filter");
+    caps = gst_caps_from_string("video/x-raw(memory:NVMM), format=I420");
+    g_object_set(G_OBJECT(cap_filter), "caps", caps, NULL);
+    qtmux = gst_element_factory_make("qtmux", "muxer");
+
+    /* Create OSD to draw on the converted RGBA buffer */
+    nvosd = gst_element_factory_make("nvdsosd", "nv-onscreendisplay");
+
+    /* Finally render the osd output */
 #ifdef PLATFORM_TEGRA
-  transform = gst_element_factory_make("nvegltransform", "nvegl-transform");
+    transform = gst_element_factory_make("nvegltransform", "nvegl-transform");
 #endif
-  nvsink = gst_element_factory_make("nveglglessink", "nvvideo-renderer");
-  sink = gst_element_factory_make("fpsdisplaysink", "fps-display");
+    nvsink = gst_element_factory_make("nveglglessink", "nvvideo-renderer");
+    sink = gst_element_factory_make("fpsdisplaysink", "fps-display");
 
-  g_object_set(G_OBJECT(sink), "text-overlay", FALSE, "video-sink", nvsink, "sync", FALSE, NULL);
+    g_object_set(G_OBJECT(sink), "text-overlay", FALSE, "video-sink", nvsink, "sync", FALSE, NULL);
 
-  if (!source || !h264parser || !decoder || !pgie || !nvvidconv || !nvosd || !sink || !cap_filter || !tee || !nvvideoconvert ||
-      !h264encoder || !filesink || !queue || !qtmux || !h264parser1)
-  {
-    g_printerr("One element could not be created. Exiting.\n");
-    return -1;
-  }
+    if (!pgie || !nvvidconv || !nvosd || !sink || !cap_filter || !tee || !nvvideoconvert ||
+        !h264encoder || !filesink || !queue || !qtmux || !h264parser1)
+    {
+      g_printerr("One element could not be created. Exiting.\n");
+      return -1;
+    }
 #ifdef PLATFORM_TEGRA
-  if (!transform)
-  {
-    g_printerr("One tegra element could not be created. Exiting.\n");
-    return -1;
-  }
+    if (!transform)
+    {
+      g_printerr("One tegra element could not be created. Exiting.\n");
+      return -1;
+    }
 #endif
+  }
 
-  /* we set the input filename to the source element */
-  g_object_set(G_OBJECT(source), "location", argv[1], NULL);
+  g_object_set(G_OBJECT(streammux), "width", muxer_width, "height",
+               muxer_height, "batch-size", num_sources,
+               "batched-push-timeout", live ? LIVE_BATCH_TIMEOUT_USEC : MUXER_BATCH_TIMEOUT_USEC, NULL);
 
-  g_object_set(G_OBJECT(streammux), "width", MUXER_OUTPUT_WIDTH, "height",
-               MUXER_OUTPUT_HEIGHT, "batch-size", 1,
-               "batched-push-timeout", MUXER_BATCH_TIMEOUT_USEC, NULL);
+  /* Live sources: batches are timestamped on arrival, and stages that fall behind drop
+   * their oldest buffers instead of letting them age in a queue. The post-processing
+   * queue of the asynchronous mode never leaks, its buffers carry submitted frames. */
+  if (live)
+  {
+    g_object_set(G_OBJECT(streammux), "live-source", TRUE, NULL);
+    inference_queue = gst_element_factory_make("queue", "inference-queue");
+    if (!inference_queue)
+    {
+      g_printerr("One element could not be created. Exiting.\n");
+      return -1;
+    }
+    g_object_set(G_OBJECT(inference_queue), "leaky", 2, "max-size-buffers", live_queue_size,
+                 "max-size-bytes", 0, "max-size-time", (guint64)0, NULL);
+    if (queue)
+      g_object_set(G_OBJECT(queue), "leaky", 2, "max-size-buffers", live_queue_size,
+                   "max-size-bytes", 0, "max-size-time", (guint64)0, NULL);
+    live_pipeline = pipeline;
+  }
 
   /* Set all the necessary properties of the nvinfer element,
    * the necessary ones are : */
   g_object_set(G_OBJECT(pgie), "output-tensor-meta", TRUE,
-               "config-file-path", "deepstream_pose_estimation_config.txt", NULL);
+               "config-file-path",
+               pgie_config_path ? pgie_config_path : "deepstream_pose_estimation_config.txt", NULL);
+
+  /* One inference per batch, overriding the batch size of the config file */
+  g_object_set(G_OBJECT(pgie), "batch-size", num_sources, NULL);
 
   /* we add a message handler */
   bus = gst_pipeline_get_bus(GST_PIPELINE(pipeline));
   bus_watch_id = gst_bus_add_watch(bus, bus_call, loop);
   gst_object_unref(bus);
+  guint metrics_timer_id = metrics_path ? g_timeout_add_seconds(metrics_interval, dump_metrics, NULL) : 0;
+  guint batch_timeout_timer_id = live ? g_timeout_add(LIVE_TIMEOUT_UPDATE_MS, update_batch_timeout, streammux) : 0;
 
   /* Set up the pipeline */
   /* we add all elements into the pipeline */
+  if (headless)
+    gst_bin_add_many(GST_BIN(pipeline), streammux, pgie, fakesink, NULL);
+  else
+  {
 #ifdef PLATFORM_TEGRA
-  gst_bin_add_many(GST_BIN(pipeline),
-                   source, h264parser, decoder, streammux, pgie,
-                   nvvidconv, nvosd, transform, /*sink,*/
-                   tee, nvvideoconvert, h264encoder, cap_filter, filesink, queue, h264parser1, qtmux, NULL);
+    gst_bin_add_many(GST_BIN(pipeline),
+                     streammux, pgie,
+                     nvvidconv, nvosd, transform, /*sink,*/
+                     tee, nvvideoconvert, h264encoder, cap_filter, filesink, queue, h264parser1, qtmux, NULL);
 #else
-  gst_bin_add_many(GST_BIN(pipeline),
-                   source, h264parser, decoder, streammux, pgie,
-                   nvvidconv, nvosd, /*sink,*/
-                   tee, nvvideoconvert, h264encoder, cap_filter, filesink, queue, h264parser1, qtmux, NULL);
+    gst_bin_add_many(GST_BIN(pipeline),
+                     streammux, pgie,
+                     nvvidconv, nvosd, /*sink,*/
+                     tee, nvvideoconvert, h264encoder, cap_filter, filesink, queue, h264parser1, qtmux, NULL);
 #endif
-
-  GstPad *sinkpad, *srcpad;
-  gchar pad_name_sink[16] = "sink_0";
-  gchar pad_name_src[16] = "src";
-
-  sinkpad = gst_element_get_request_pad(streammux, pad_name_sink);
-  if (!sinkpad)
-  {
-    g_printerr("Streammux request sink pad failed. Exiting.\n");
-    return -1;
   }
-
-  srcpad = gst_element_get_static_pad(decoder, pad_name_src);
-  if (!srcpad)
+  if (post_process_queue)
+    gst_bin_add(GST_BIN(pipeline), post_process_queue);
+  if (pose_parse)
+    gst_bin_add(GST_BIN(pipeline), pose_parse);
+  if (inference_queue)
+    gst_bin_add(GST_BIN(pipeline), inference_queue);
+
+  if (tiler)
+    gst_bin_add(GST_BIN(pipeline), tiler);
+
+  /* Input i feeds muxer pad sink_i and becomes source_id i */
+  for (guint i = 0; i < num_sources; i++)
   {
-    g_printerr("Decoder request src pad failed. Exiting.\n");
-    return -1;
+    if (!add_source(pipeline, streammux, i, argv[i + 1]))
+      return -1;
   }
-
-  if (gst_pad_link(srcpad, sinkpad) != GST_PAD_LINK_OK)
+  if (headless)
   {
-    g_printerr("Failed to link decoder to stream muxer. Exiting.\n");
-    return -1;
+    if (!(inference_queue ? gst_element_link_many(streammux, inference_queue, pgie, NULL)
+                          : gst_element_link(streammux, pgie)) ||
+        !link_post_process(pgie, post_process_queue, pose_parse, fakesink))
+    {
+      g_printerr("Elements could not be linked. Exiting.\n");
+      return -1;
+    }
   }
-
-  gst_object_unref(sinkpad);
-  gst_object_unref(srcpad);
-
-  if (!gst_element_link_many(source, h264parser, decoder, NULL))
+  else
   {
-    g_printerr("Elements could not be linked: 1. Exiting.\n");
-    return -1;
-  }
 #if 0
 #ifdef PLATFORM_TEGRA
-  if (!gst_element_link_many (streammux, pgie,
-          nvvidconv, nvosd, transform, sink, NULL)) {
-    g_printerr ("Elements could not be linked: 2. Exiting.\n");
-    return -1;
-  }
+    if (!gst_element_link_many (streammux, pgie,
+            nvvidconv, nvosd, transform, sink, NULL)) {
+      g_printerr ("Elements could not be linked: 2. Exiting.\n");
+      return -1;
+    }
 #else
-  if (!gst_element_link_many (streammux, pgie, nvvidconv, nvosd, sink, NULL)) {
-    g_printerr ("Elements could not be linked: 2. Exiting.\n");
-    return -1;
-  }
+    if (!gst_element_link_many (streammux, pgie, nvvidconv, nvosd, sink, NULL)) {
+      g_printerr ("Elements could not be linked: 2. Exiting.\n");
+      return -1;
+    }
 #endif
 #else
 #ifdef PLATFORM_TEGRA
-  if (!gst_element_link_many(streammux, pgie,
-                             nvvidconv, nvosd, tee, NULL))
-  {
-    g_printerr("Elements could not be linked: 2. Exiting.\n");
-    return -1;
-  }
+    if (!(inference_queue ? gst_element_link_many(streammux, inference_queue, pgie, NULL)
+                          : gst_element_link(streammux, pgie)) ||
+        !link_post_process(pgie, post_process_queue, pose_parse, nvvidconv) ||
+        !(tiler ? gst_element_link_many(nvvidconv, tiler, nvosd, NULL)
+                : gst_element_link(nvvidconv, nvosd)) ||
+        !gst_element_link(nvosd, tee))
+    {
+      g_printerr("Elements could not be linked: 2. Exiting.\n");
+      return -1;
+    }
 #else
-  if (!gst_element_link_many(streammux, pgie, nvvidconv, nvosd, tee, NULL))
-  {
-    g_printerr("Elements could not be linked: 2. Exiting.\n");
-    return -1;
-  }
+    if (!(inference_queue ? gst_element_link_many(streammux, inference_queue, pgie, NULL)
+                          : gst_element_link(streammux, pgie)) ||
+        !link_post_process(pgie, post_process_queue, pose_parse, nvvidconv) ||
+        !(tiler ? gst_element_link_many(nvvidconv, tiler, nvosd, NULL)
+                : gst_element_link(nvvidconv, nvosd)) ||
+        !gst_element_link(nvosd, tee))
+    {
+      g_printerr("Elements could not be linked: 2. Exiting.\n");
+      return -1;
+    }
 #endif
 #if 0
-  if (!link_element_to_tee_src_pad(tee, queue)) {
-      g_printerr ("Could not link tee to sink\n");
+    if (!link_element_to_tee_src_pad(tee, queue)) {
+        g_printerr ("Could not link tee to sink\n");
+        return -1;
+    }
+    if (!gst_element_link_many (queue, sink, NULL)) {
+      g_printerr ("Elements could not be linked: 2. Exiting.\n");
       return -1;
-  }
-  if (!gst_element_link_many (queue, sink, NULL)) {
-    g_printerr ("Elements could not be linked: 2. Exiting.\n");
-    return -1;
-  }
+    }
 #else
-  if (!link_element_to_tee_src_pad(tee, queue))
-  {
-    g_printerr("Could not link tee to nvvideoconvert\n");
-    return -1;
-  }
-  if (!gst_element_link_many(queue, nvvideoconvert, cap_filter, h264encoder,
-                             h264parser1, qtmux, filesink, NULL))
-  {
-    g_printerr("Elements could not be linked\n");
-    return -1;
-  }
+    if (!link_element_to_tee_src_pad(tee, queue))
+    {
+      g_printerr("Could not link tee to nvvideoconvert\n");
+      return -1;
+    }
+    if (!gst_element_link_many(queue, nvvideoconvert, cap_filter, h264encoder,
+                               h264parser1, qtmux, filesink, NULL))
+    {
+      g_printerr("Elements could not be linked\n");
+      return -1;
+    }
 #endif
 
 #endif
+  }
 
-  GstPad *pgie_src_pad = gst_element_get_static_pad(pgie, "src");
-  if (!pgie_src_pad)
-    g_print("Unable to get pgie src pad\n");
+  /* The nvdsposeparse element replaces the post-processing probe of nvinfer, its
+   * poses are tracked and written behind it */
+  if (pose_parse)
+  {
+    GstPad *pose_parse_src_pad = gst_element_get_static_pad(pose_parse, "src");
+    if (!pose_parse_src_pad)
+      g_print("Unable to get pose parser src pad\n");
+    else
+    {
+      gst_pad_add_probe(pose_parse_src_pad, GST_PAD_PROBE_TYPE_BUFFER, pose_parse_src_pad_buffer_probe,
+                        NULL, NULL);
+      gst_object_unref(pose_parse_src_pad);
+    }
+  }
   else
-    gst_pad_add_probe(pgie_src_pad, GST_PAD_PROBE_TYPE_BUFFER,
-                      pgie_src_pad_buffer_probe, (gpointer)sink, NULL);
+  {
+    GstPad *pgie_src_pad = gst_element_get_static_pad(pgie, "src");
+    if (!pgie_src_pad)
+      g_print("Unable to get pgie src pad\n");
+    else
+      gst_pad_add_probe(pgie_src_pad, GST_PAD_PROBE_TYPE_BUFFER,
+                        skeleton == SKELETON_HAND ? pgie_src_pad_buffer_probe<HandSkeleton>
+                                                    : pgie_src_pad_buffer_probe<BodySkeleton>,
+                        (gpointer)sink, NULL);
+  }
+
+  /* Results of the asynchronous post-processing are attached before the conversion
+   * for the OSD, or before the fakesink when headless, behind the queue so the
+   * inference thread never waits for them */
+  if (pose_async)
+  {
+    GstPad *attach_pad = gst_element_get_static_pad(headless ? fakesink : nvvidconv, "sink");
+    if (!attach_pad)
+      g_print("Unable to get attach sink pad\n");
+    else
+    {
+      gst_pad_add_probe(attach_pad, GST_PAD_PROBE_TYPE_BUFFER,
+                        skeleton == SKELETON_HAND ? attach_pad_buffer_probe<HandSkeleton>
+                                                    : attach_pad_buffer_probe<BodySkeleton>,
+                        NULL, NULL);
+      gst_pad_add_probe(attach_pad,
+                        (GstPadProbeType)(GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+                        attach_pad_event_probe, NULL, NULL);
+      gst_object_unref(attach_pad);
+    }
+  }
 
   /* Lets add probe to get informed of the meta data generated, we add probe to
    * the sink pad of the osd element, since by that time, the buffer would have
-   * had got all the metadata. */
-  osd_sink_pad = gst_element_get_static_pad(nvosd, "sink");
-  if (!osd_sink_pad)
-    g_print("Unable to get sink pad\n");
-  else
-    gst_pad_add_probe(osd_sink_pad, GST_PAD_PROBE_TYPE_BUFFER,
-                      osd_sink_pad_buffer_probe, (gpointer)sink, NULL);
+   * had got all the metadata. The tiler merges the frames of a batch, so with
+   * several sources the labels are added at its sink pad instead. Nothing is drawn
+   * when headless. */
+  if (!headless)
+  {
+    osd_sink_pad = gst_element_get_static_pad(tiler ? tiler : nvosd, "sink");
+    if (!osd_sink_pad)
+      g_print("Unable to get sink pad\n");
+    else
+      gst_pad_add_probe(osd_sink_pad, GST_PAD_PROBE_TYPE_BUFFER,
+                        osd_sink_pad_buffer_probe, (gpointer)sink, NULL);
+  }
 
   /* Set the pipeline to "playing" state */
-  g_print("Now playing: %s\n", argv[1]);
+  for (guint i = 0; i < num_sources; i++)
+    g_print("Now playing: %s\n", argv[i + 1]);
   gst_element_set_state(pipeline, GST_STATE_PLAYING);
 
   /* Wait till pipeline encounters an error or EOS */
@@ -572,10 +1407,28 @@ int main(int argc, char *argv[])
 
   /* Out of the main loop, clean up nicely */
   g_print("Returned, stopping playback\n");
+  if (pose_async)
+    pose_async->stop();
   gst_element_set_state(pipeline, GST_STATE_NULL);
   g_print("Deleting pipeline\n");
   gst_object_unref(GST_OBJECT(pipeline));
   g_source_remove(bus_watch_id);
+  if (batch_timeout_timer_id)
+    g_source_remove(batch_timeout_timer_id);
+  if (metrics_timer_id)
+  {
+    g_source_remove(metrics_timer_id);
+    dump_metrics(NULL);
+  }
   g_main_loop_unref(loop);
+  if (!tensor_capture.close())
+    g_printerr("Failed to finalize tensor capture '%s', its records are recovered without index\n",
+               capture_tensors_path);
+  pose_results.close();
+  if (pose_results.droppedFrames() || pose_results.hasFailed())
+    g_printerr("Results file: %ld frame(s) dropped%s\n", pose_results.droppedFrames(),
+               pose_results.hasFailed() ? ", writing failed" : "");
+  delete pose_async;
+  delete pose_scheduler;
   return 0;
 }
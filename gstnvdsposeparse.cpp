@@ -0,0 +1,556 @@
+// Copyright 2020 - NVIDIA Corporation
+// SPDX-License-Identifier: MIT
+
+/* nvdsposeparse, the pose post-processing of this app as a GStreamer element. It parses the
+   cmap/paf tensor output meta nvinfer attaches with output-tensor-meta=TRUE in place on the
+   batched buffers, and attaches a PoseMeta and the OSD drawing to every frame:
+
+     ... ! nvinfer output-tensor-meta=TRUE ! queue ! nvdsposeparse ! nvvideoconvert ! nvdsosd ! ...
+
+   The frames of a batch are post-processed on the element's own thread pool. Build with
+   'make plugin' and point GST_PLUGIN_PATH at the directory holding the library. */
+
+#include "post_process.cpp"
+#include "pose_meta.hpp"
+#include "pose_display.hpp"
+#include "gstnvdsposeparse.h"
+
+#include <gst/video/video.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#define PACKAGE "nvdsposeparse"
+#define VERSION "1.0"
+#define DESCRIPTION "Parses the tensor output of a pose estimation network into pose and display metadata"
+#define LICENSE "MIT/X11"
+#define BINARY_PACKAGE "NVIDIA DeepStream pose estimation"
+#define URL "https://github.com/NVIDIA-AI-IOT/deepstream_pose_estimation"
+
+GST_DEBUG_CATEGORY_STATIC(gst_nvdsposeparse_debug);
+#define GST_CAT_DEFAULT gst_nvdsposeparse_debug
+
+enum
+{
+  PROP_0,
+  PROP_SKELETON,
+  PROP_THRESHOLD,
+  PROP_LINK_THRESHOLD,
+  PROP_WINDOW_SIZE,
+  PROP_MAX_NUM_PARTS,
+  PROP_NUM_INTEGRAL_SAMPLES,
+  PROP_MAX_NUM_OBJECTS,
+  PROP_PEAK_DETECTOR,
+  PROP_SOLVER,
+  PROP_PRUNE_LINKS,
+  PROP_CMAP_INT8_SCALE,
+  PROP_PAF_INT8_SCALE,
+  PROP_THREADS,
+  PROP_BATCH_PARALLELISM,
+  PROP_DISPLAY
+};
+
+/* Batched NVMM frames of any format, the element only touches their metadata */
+static GstStaticPadTemplate gst_nvdsposeparse_sink_template =
+    GST_STATIC_PAD_TEMPLATE("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+                            GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE_WITH_FEATURES("memory:NVMM", "{ NV12, RGBA, I420 }")));
+
+static GstStaticPadTemplate gst_nvdsposeparse_src_template =
+    GST_STATIC_PAD_TEMPLATE("src", GST_PAD_SRC, GST_PAD_ALWAYS,
+                            GST_STATIC_CAPS(GST_VIDEO_CAPS_MAKE_WITH_FEATURES("memory:NVMM", "{ NV12, RGBA, I420 }")));
+
+/* Properties of the element, written by the setters under the object lock */
+struct PoseParseSettings
+{
+  SkeletonType skeleton = SKELETON_BODY;
+  PostProcessParams params;
+  gdouble cmap_int8_scale = 1.0 / 127.0;
+  gdouble paf_int8_scale = 1.0 / 127.0;
+  guint threads = 0;
+  guint batch_parallelism = 1;
+  gboolean display = TRUE;
+};
+
+/* Peaks of the previous frame of a source, one per tensor output of its frames */
+struct PoseParseSource
+{
+  std::vector<std::unique_ptr<PeakSearchState>> peak_searches;
+};
+
+/* A tensor output of the current batch and the buffers its post-processing uses */
+struct PoseParseFrame
+{
+  NvDsFrameMeta *frame_meta;
+  NvDsInferTensorMeta *tensor_meta;
+  PostProcessWorkspace *workspace;
+  PeakSearchState *search_state;
+};
+
+struct NvDsPoseParseState
+{
+  PoseParseSettings settings;
+  PoseParseSettings active; /* copy of 'settings' the current buffer is parsed with */
+
+  /* Pool shared by the frames of a batch and the stages of each frame, created on start */
+  std::unique_ptr<TaskScheduler> scheduler;
+  TaskGraph batch_graph;
+  std::vector<PoseParseFrame> frames;
+  std::atomic<int> next_frame;
+
+  /* Post-processing buffers per tensor output slot of the batch, which may hold several
+     frames of one source */
+  std::vector<std::unique_ptr<PostProcessWorkspace>> workspaces;
+
+  std::vector<PoseParseSource> sources; /* indexed by source_id */
+  PoseDisplayBuilder<BodySkeleton> body_display;
+  PoseDisplayBuilder<HandSkeleton> hand_display;
+  gint frame_width = 0;
+  gint frame_height = 0;
+
+  std::atomic<int> reported_checks{0}; /* TensorCheck bits already warned about */
+};
+
+#define gst_nvdsposeparse_parent_class parent_class
+G_DEFINE_TYPE(GstNvDsPoseParse, gst_nvdsposeparse, GST_TYPE_BASE_TRANSFORM);
+
+/* Post-processes one tensor output, leaving no people in the workspace when the tensors do
+   not fit the skeleton */
+template <class Skeleton>
+static void
+parse_frame(GstNvDsPoseParse *self, PoseParseFrame &frame)
+{
+  NvDsPoseParseState &state = *self->state;
+  NvDsInferTensorMeta *tensor_meta = frame.tensor_meta;
+  PostProcessWorkspace &workspace = *frame.workspace;
+  workspace.num_objects = 0;
+
+  TensorFormat cmap_format, paf_format;
+  char message[160];
+  TensorCheck check = check_tensor_meta<Skeleton>(tensor_meta, cmap_format, paf_format, message, sizeof(message));
+  if (check != TENSOR_CHECK_OK)
+  {
+    if (!(state.reported_checks.fetch_or(1 << check) & (1 << check)))
+      GST_ELEMENT_WARNING(self, STREAM, FORMAT, (NULL), ("%s", message));
+    return;
+  }
+  cmap_format.int8_scale = state.active.cmap_int8_scale;
+  paf_format.int8_scale = state.active.paf_int8_scale;
+
+  void *cmap_data = tensor_meta->out_buf_ptrs_host[0];
+  NvDsInferDims &cmap_dims = tensor_meta->output_layers_info[0].inferDims;
+  void *paf_data = tensor_meta->out_buf_ptrs_host[1];
+  NvDsInferDims &paf_dims = tensor_meta->output_layers_info[1].inferDims;
+
+  const PostProcessParams &params = state.active.params;
+  workspace.reserve(Skeleton::NUM_PARTS, Skeleton::NUM_LINKS, cmap_dims.d[1], cmap_dims.d[2],
+                    params.max_num_parts, params.max_num_objects);
+  TaskScheduler *scheduler = state.active.threads > 0 ? state.scheduler.get() : NULL;
+  run_post_process<Skeleton>(workspace, scheduler, cmap_data, cmap_dims, paf_data, paf_dims, params,
+                             frame.search_state, cmap_format, paf_format);
+}
+
+/* 'batch-parallelism' runner tasks pull frames of the batch until none are left */
+template <class Skeleton>
+static void
+run_frames_task(Task *task)
+{
+  GstNvDsPoseParse *self = (GstNvDsPoseParse *)task->context;
+  NvDsPoseParseState &state = *self->state;
+  int num_frames = state.frames.size();
+  for (int i = state.next_frame++; i < num_frames; i = state.next_frame++)
+    parse_frame<Skeleton>(self, state.frames[i]);
+}
+
+/* Queues tensor output 'output' of a frame with the workspace of its batch slot and the
+   peak search state its source keeps for the output */
+static void
+add_frame(NvDsPoseParseState &state, NvDsFrameMeta *frame_meta, NvDsInferTensorMeta *tensor_meta, int output)
+{
+  if (frame_meta->source_id >= state.sources.size())
+    state.sources.resize(frame_meta->source_id + 1);
+  PoseParseSource &source = state.sources[frame_meta->source_id];
+  if (output == (int)source.peak_searches.size())
+    source.peak_searches.emplace_back(new PeakSearchState());
+  size_t slot = state.frames.size();
+  if (slot == state.workspaces.size())
+    state.workspaces.emplace_back(new PostProcessWorkspace());
+  state.frames.push_back({frame_meta, tensor_meta, state.workspaces[slot].get(),
+                          source.peak_searches[output].get()});
+}
+
+template <class Skeleton>
+static void
+transform_batch(GstNvDsPoseParse *self, NvDsBatchMeta *batch_meta, PoseDisplayBuilder<Skeleton> &display)
+{
+  NvDsPoseParseState &state = *self->state;
+  state.frames.clear();
+
+  for (NvDsMetaList *l_frame = batch_meta->frame_meta_list; l_frame != NULL; l_frame = l_frame->next)
+  {
+    NvDsFrameMeta *frame_meta = (NvDsFrameMeta *)l_frame->data;
+    int outputs = 0;
+
+    for (NvDsMetaList *l_user = frame_meta->frame_user_meta_list; l_user != NULL; l_user = l_user->next)
+    {
+      NvDsUserMeta *user_meta = (NvDsUserMeta *)l_user->data;
+      if (user_meta->base_meta.meta_type == NVDSINFER_TENSOR_OUTPUT_META)
+        add_frame(state, frame_meta, (NvDsInferTensorMeta *)user_meta->user_meta_data, outputs++);
+    }
+
+    for (NvDsMetaList *l_obj = frame_meta->obj_meta_list; l_obj != NULL; l_obj = l_obj->next)
+    {
+      NvDsObjectMeta *obj_meta = (NvDsObjectMeta *)l_obj->data;
+      for (NvDsMetaList *l_user = obj_meta->obj_user_meta_list; l_user != NULL; l_user = l_user->next)
+      {
+        NvDsUserMeta *user_meta = (NvDsUserMeta *)l_user->data;
+        if (user_meta->base_meta.meta_type == NVDSINFER_TENSOR_OUTPUT_META)
+          add_frame(state, frame_meta, (NvDsInferTensorMeta *)user_meta->user_meta_data, outputs++);
+      }
+    }
+  }
+
+  /* The runner tasks share the frames out, one source's frames have to stay in order */
+  state.next_frame = 0;
+  if (state.scheduler && state.batch_graph.size() > 1 && state.frames.size() > 1 &&
+      !frames_share_search_state(state.frames))
+  {
+    for (int i = 0; i < state.batch_graph.size(); i++)
+      state.batch_graph.task(i).run = run_frames_task<Skeleton>;
+    state.scheduler->run(state.batch_graph);
+  }
+  else
+  {
+    for (PoseParseFrame &frame : state.frames)
+      parse_frame<Skeleton>(self, frame);
+  }
+
+  /* Meta pools are not thread-safe, attach the results on the streaming thread */
+  for (PoseParseFrame &frame : state.frames)
+  {
+    attach_pose_meta<Skeleton>(*frame.workspace, frame.frame_meta);
+    if (state.active.display && state.frame_width > 0)
+      display.build(*frame.workspace, frame.frame_meta, state.frame_width, state.frame_height);
+  }
+}
+
+static GstFlowReturn
+gst_nvdsposeparse_transform_ip(GstBaseTransform *btrans, GstBuffer *buf)
+{
+  GstNvDsPoseParse *self = GST_NVDSPOSEPARSE(btrans);
+  NvDsPoseParseState &state = *self->state;
+
+  NvDsBatchMeta *batch_meta = gst_buffer_get_nvds_batch_meta(buf);
+  if (!batch_meta)
+  {
+    GST_WARNING_OBJECT(self, "Buffer without batch meta, nvdsposeparse must follow nvstreammux and nvinfer");
+    return GST_FLOW_OK;
+  }
+
+  GST_OBJECT_LOCK(self);
+  state.active = state.settings;
+  GST_OBJECT_UNLOCK(self);
+
+  if (state.active.skeleton == SKELETON_HAND)
+    transform_batch<HandSkeleton>(self, batch_meta, state.hand_display);
+  else
+    transform_batch<BodySkeleton>(self, batch_meta, state.body_display);
+  return GST_FLOW_OK;
+}
+
+/* The display meta is drawn on the batched frames, whose size the caps give */
+static gboolean
+gst_nvdsposeparse_set_caps(GstBaseTransform *btrans, GstCaps *incaps, GstCaps *outcaps)
+{
+  GstNvDsPoseParse *self = GST_NVDSPOSEPARSE(btrans);
+  GstVideoInfo info;
+  if (!gst_video_info_from_caps(&info, incaps))
+  {
+    GST_ERROR_OBJECT(self, "Failed to parse the input caps");
+    return FALSE;
+  }
+  self->state->frame_width = GST_VIDEO_INFO_WIDTH(&info);
+  self->state->frame_height = GST_VIDEO_INFO_HEIGHT(&info);
+  return TRUE;
+}
+
+/* Creates the thread pool, the pool settings only change in the READY state */
+static gboolean
+gst_nvdsposeparse_start(GstBaseTransform *btrans)
+{
+  GstNvDsPoseParse *self = GST_NVDSPOSEPARSE(btrans);
+  NvDsPoseParseState &state = *self->state;
+
+  GST_OBJECT_LOCK(self);
+  guint threads = state.settings.threads;
+  guint batch_parallelism = state.settings.batch_parallelism;
+  GST_OBJECT_UNLOCK(self);
+
+  if (threads > 0 || batch_parallelism > 1)
+    state.scheduler.reset(new TaskScheduler(MAX(threads, batch_parallelism - 1)));
+  state.batch_graph.resize(batch_parallelism);
+  for (guint i = 0; i < batch_parallelism; i++)
+    state.batch_graph.task(i).context = self;
+  return TRUE;
+}
+
+static gboolean
+gst_nvdsposeparse_stop(GstBaseTransform *btrans)
+{
+  NvDsPoseParseState &state = *GST_NVDSPOSEPARSE(btrans)->state;
+  state.scheduler.reset();
+  state.frames.clear();
+  state.workspaces.clear();
+  state.sources.clear();
+  return TRUE;
+}
+
+static void
+gst_nvdsposeparse_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+  GstNvDsPoseParse *self = GST_NVDSPOSEPARSE(object);
+  PoseParseSettings &settings = self->state->settings;
+  const gchar *name = NULL;
+
+  GST_OBJECT_LOCK(self);
+  switch (prop_id)
+  {
+  case PROP_SKELETON:
+    name = g_value_get_string(value);
+    if (!name || !skeleton_from_string(name, settings.skeleton))
+      GST_WARNING_OBJECT(self, "Unknown skeleton '%s'", GST_STR_NULL(name));
+    break;
+  case PROP_THRESHOLD:
+    settings.params.threshold = g_value_get_float(value);
+    break;
+  case PROP_LINK_THRESHOLD:
+    settings.params.link_threshold = g_value_get_float(value);
+    break;
+  case PROP_WINDOW_SIZE:
+    /* The peak window is centered on the pixel, so it must be odd */
+    if (g_value_get_uint(value) % 2)
+      settings.params.window_size = g_value_get_uint(value);
+    else
+      GST_WARNING_OBJECT(self, "Window size %u is not odd", g_value_get_uint(value));
+    break;
+  case PROP_MAX_NUM_PARTS:
+    settings.params.max_num_parts = g_value_get_uint(value);
+    break;
+  case PROP_NUM_INTEGRAL_SAMPLES:
+    settings.params.num_integral_samples = g_value_get_uint(value);
+    break;
+  case PROP_MAX_NUM_OBJECTS:
+    settings.params.max_num_objects = g_value_get_uint(value);
+    break;
+  case PROP_PEAK_DETECTOR:
+    name = g_value_get_string(value);
+    if (!name || !peak_detector_from_string(name, settings.params.peak_detector))
+      GST_WARNING_OBJECT(self, "Unknown peak detector '%s'", GST_STR_NULL(name));
+    break;
+  case PROP_SOLVER:
+    name = g_value_get_string(value);
+    if (!name || !assignment_solver_from_string(name, settings.params.solver))
+      GST_WARNING_OBJECT(self, "Unknown assignment solver '%s'", GST_STR_NULL(name));
+    break;
+  case PROP_PRUNE_LINKS:
+    settings.params.prune_links = g_value_get_boolean(value);
+    break;
+  case PROP_CMAP_INT8_SCALE:
+    settings.cmap_int8_scale = g_value_get_double(value);
+    break;
+  case PROP_PAF_INT8_SCALE:
+    settings.paf_int8_scale = g_value_get_double(value);
+    break;
+  case PROP_THREADS:
+    settings.threads = g_value_get_uint(value);
+    break;
+  case PROP_BATCH_PARALLELISM:
+    settings.batch_parallelism = g_value_get_uint(value);
+    break;
+  case PROP_DISPLAY:
+    settings.display = g_value_get_boolean(value);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+  GST_OBJECT_UNLOCK(self);
+}
+
+static void
+gst_nvdsposeparse_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  GstNvDsPoseParse *self = GST_NVDSPOSEPARSE(object);
+  PoseParseSettings &settings = self->state->settings;
+
+  GST_OBJECT_LOCK(self);
+  switch (prop_id)
+  {
+  case PROP_SKELETON:
+    g_value_set_string(value, settings.skeleton == SKELETON_HAND ? HandSkeleton::NAME : BodySkeleton::NAME);
+    break;
+  case PROP_THRESHOLD:
+    g_value_set_float(value, settings.params.threshold);
+    break;
+  case PROP_LINK_THRESHOLD:
+    g_value_set_float(value, settings.params.link_threshold);
+    break;
+  case PROP_WINDOW_SIZE:
+    g_value_set_uint(value, settings.params.window_size);
+    break;
+  case PROP_MAX_NUM_PARTS:
+    g_value_set_uint(value, settings.params.max_num_parts);
+    break;
+  case PROP_NUM_INTEGRAL_SAMPLES:
+    g_value_set_uint(value, settings.params.num_integral_samples);
+    break;
+  case PROP_MAX_NUM_OBJECTS:
+    g_value_set_uint(value, settings.params.max_num_objects);
+    break;
+  case PROP_PEAK_DETECTOR:
+    g_value_set_string(value, peak_detector_names[settings.params.peak_detector]);
+    break;
+  case PROP_SOLVER:
+    g_value_set_string(value, assignment_solver_names[settings.params.solver]);
+    break;
+  case PROP_PRUNE_LINKS:
+    g_value_set_boolean(value, settings.params.prune_links);
+    break;
+  case PROP_CMAP_INT8_SCALE:
+    g_value_set_double(value, settings.cmap_int8_scale);
+    break;
+  case PROP_PAF_INT8_SCALE:
+    g_value_set_double(value, settings.paf_int8_scale);
+    break;
+  case PROP_THREADS:
+    g_value_set_uint(value, settings.threads);
+    break;
+  case PROP_BATCH_PARALLELISM:
+    g_value_set_uint(value, settings.batch_parallelism);
+    break;
+  case PROP_DISPLAY:
+    g_value_set_boolean(value, settings.display);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+    break;
+  }
+  GST_OBJECT_UNLOCK(self);
+}
+
+static void
+gst_nvdsposeparse_finalize(GObject *object)
+{
+  GstNvDsPoseParse *self = GST_NVDSPOSEPARSE(object);
+  delete self->state;
+  self->state = NULL;
+  G_OBJECT_CLASS(parent_class)->finalize(object);
+}
+
+static void
+gst_nvdsposeparse_class_init(GstNvDsPoseParseClass *klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+  GstBaseTransformClass *btrans_class = GST_BASE_TRANSFORM_CLASS(klass);
+  GParamFlags flags = (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING);
+  GParamFlags ready_flags = (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY);
+  PostProcessParams defaults;
+
+  gobject_class->set_property = gst_nvdsposeparse_set_property;
+  gobject_class->get_property = gst_nvdsposeparse_get_property;
+  gobject_class->finalize = gst_nvdsposeparse_finalize;
+
+  btrans_class->transform_ip = GST_DEBUG_FUNCPTR(gst_nvdsposeparse_transform_ip);
+  btrans_class->set_caps = GST_DEBUG_FUNCPTR(gst_nvdsposeparse_set_caps);
+  btrans_class->start = GST_DEBUG_FUNCPTR(gst_nvdsposeparse_start);
+  btrans_class->stop = GST_DEBUG_FUNCPTR(gst_nvdsposeparse_stop);
+
+  g_object_class_install_property(
+      gobject_class, PROP_SKELETON,
+      g_param_spec_string("skeleton", "Skeleton", "Keypoint model of the network: 'body' or 'hand'",
+                          BodySkeleton::NAME, flags));
+  g_object_class_install_property(
+      gobject_class, PROP_THRESHOLD,
+      g_param_spec_float("threshold", "Peak threshold", "Confidence map value a peak must exceed",
+                         0.0f, 1.0f, defaults.threshold, flags));
+  g_object_class_install_property(
+      gobject_class, PROP_LINK_THRESHOLD,
+      g_param_spec_float("link-threshold", "Link threshold", "PAF score a link must exceed",
+                         0.0f, G_MAXFLOAT, defaults.link_threshold, flags));
+  g_object_class_install_property(
+      gobject_class, PROP_WINDOW_SIZE,
+      g_param_spec_uint("window-size", "Window size", "Odd side of the peak and refinement window",
+                        1, 63, defaults.window_size, flags));
+  g_object_class_install_property(
+      gobject_class, PROP_MAX_NUM_PARTS,
+      g_param_spec_uint("max-num-parts", "Maximum parts", "Peaks kept per confidence map channel",
+                        1, G_MAXINT, defaults.max_num_parts, flags));
+  g_object_class_install_property(
+      gobject_class, PROP_NUM_INTEGRAL_SAMPLES,
+      g_param_spec_uint("num-integral-samples", "PAF samples", "Samples of the PAF line integral per link",
+                        2, G_MAXINT, defaults.num_integral_samples, flags));
+  g_object_class_install_property(
+      gobject_class, PROP_MAX_NUM_OBJECTS,
+      g_param_spec_uint("max-num-objects", "Maximum objects", "People kept per frame",
+                        1, G_MAXINT, defaults.max_num_objects, flags));
+  g_object_class_install_property(
+      gobject_class, PROP_PEAK_DETECTOR,
+      g_param_spec_string("peak-detector", "Peak detector",
+                          "Peak detector: 'window', 'separable', 'compact' or 'pyramid'",
+                          peak_detector_names[defaults.peak_detector], flags));
+  g_object_class_install_property(
+      gobject_class, PROP_SOLVER,
+      g_param_spec_string("solver", "Assignment solver", "Limb assignment solver: 'munkres', 'lapjv' or 'greedy'",
+                          assignment_solver_names[defaults.solver], flags));
+  g_object_class_install_property(
+      gobject_class, PROP_PRUNE_LINKS,
+      g_param_spec_boolean("prune-links", "Prune links", "Drop limb candidates at or below the link threshold "
+                           "before the assignment", defaults.prune_links, flags));
+  g_object_class_install_property(
+      gobject_class, PROP_CMAP_INT8_SCALE,
+      g_param_spec_double("cmap-int8-scale", "cmap INT8 scale", "Value of one quantization step of an INT8 cmap",
+                          G_MINDOUBLE, G_MAXDOUBLE, 1.0 / 127.0, flags));
+  g_object_class_install_property(
+      gobject_class, PROP_PAF_INT8_SCALE,
+      g_param_spec_double("paf-int8-scale", "paf INT8 scale", "Value of one quantization step of an INT8 paf",
+                          G_MINDOUBLE, G_MAXDOUBLE, 1.0 / 127.0, flags));
+  g_object_class_install_property(
+      gobject_class, PROP_THREADS,
+      g_param_spec_uint("threads", "Threads", "Extra threads a frame's post-processing runs on, 0 is serial",
+                        0, 256, 0, ready_flags));
+  g_object_class_install_property(
+      gobject_class, PROP_BATCH_PARALLELISM,
+      g_param_spec_uint("batch-parallelism", "Batch parallelism", "Frames of a batch post-processed concurrently",
+                        1, 256, 1, ready_flags));
+  g_object_class_install_property(
+      gobject_class, PROP_DISPLAY,
+      g_param_spec_boolean("display", "Display", "Attach display meta drawing the poses for nvdsosd",
+                           TRUE, flags));
+
+  gst_element_class_add_static_pad_template(element_class, &gst_nvdsposeparse_sink_template);
+  gst_element_class_add_static_pad_template(element_class, &gst_nvdsposeparse_src_template);
+  gst_element_class_set_static_metadata(element_class, "Pose estimation parser", "Filter/Metadata",
+                                        DESCRIPTION, "NVIDIA Corporation");
+}
+
+static void
+gst_nvdsposeparse_init(GstNvDsPoseParse *self)
+{
+  GstBaseTransform *btrans = GST_BASE_TRANSFORM(self);
+
+  /* Only metadata is written, the frames pass through untouched */
+  gst_base_transform_set_in_place(btrans, TRUE);
+  gst_base_transform_set_passthrough(btrans, TRUE);
+  self->state = new NvDsPoseParseState();
+}
+
+static gboolean
+nvdsposeparse_plugin_init(GstPlugin *plugin)
+{
+  GST_DEBUG_CATEGORY_INIT(gst_nvdsposeparse_debug, "nvdsposeparse", 0, "nvdsposeparse element");
+  return gst_element_register(plugin, "nvdsposeparse", GST_RANK_PRIMARY, GST_TYPE_NVDSPOSEPARSE);
+}
+
+GST_PLUGIN_DEFINE(GST_VERSION_MAJOR, GST_VERSION_MINOR, nvdsgst_poseparse, DESCRIPTION,
+                  nvdsposeparse_plugin_init, VERSION, LICENSE, BINARY_PACKAGE, URL)
@@ -0,0 +1,34 @@
+// Copyright 2020 - NVIDIA Corporation
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <gst/base/gstbasetransform.h>
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_NVDSPOSEPARSE (gst_nvdsposeparse_get_type())
+#define GST_NVDSPOSEPARSE(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_NVDSPOSEPARSE, GstNvDsPoseParse))
+
+typedef struct _GstNvDsPoseParse GstNvDsPoseParse;
+typedef struct _GstNvDsPoseParseClass GstNvDsPoseParseClass;
+
+/* Settings, thread pool and per-source buffers, see gstnvdsposeparse.cpp */
+struct NvDsPoseParseState;
+
+struct _GstNvDsPoseParse
+{
+  GstBaseTransform parent;
+
+  NvDsPoseParseState *state;
+};
+
+struct _GstNvDsPoseParseClass
+{
+  GstBaseTransformClass parent_class;
+};
+
+GType gst_nvdsposeparse_get_type(void);
+
+G_END_DECLS
@@ -0,0 +1,23 @@
+#pragma once
+
+/**
+ * Non-owning view of a row-major 2D block inside a flat buffer. Rows are
+ * 'stride' elements apart, so view[i][j] addresses the same element as the
+ * nested Vec2D indexing it replaces without any per-row allocation.
+ */
+template <class T>
+class MatrixView
+{
+public:
+  MatrixView() : data(nullptr), stride(0) {}
+
+  MatrixView(T *data, int stride) : data(data), stride(stride) {}
+
+  inline T *operator[](int row) const
+  {
+    return data + row * stride;
+  }
+
+  T *data;
+  int stride;
+};
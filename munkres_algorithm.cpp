@@ -1,5 +1,6 @@
 #include "pair_graph.hpp"
 #include "cover_table.hpp"
+#include "matrix_view.hpp"
 
 #include <stdio.h>
 #include <vector>
@@ -15,7 +16,7 @@ template <class T>
 using Vec3D = std::vector<Vec2D<T>>;
 
 // Helper method to subtract the minimum row from cost_graph
-void subtract_minimum_row(Vec2D<float> &cost_graph, int nrows, int ncols)
+void subtract_minimum_row(MatrixView<float> cost_graph, int nrows, int ncols)
 {
   for (int i = 0; i < nrows; i++)
   {
@@ -39,7 +40,7 @@ void subtract_minimum_row(Vec2D<float> &cost_graph, int nrows, int ncols)
 }
 
 // Helper method to subtract the minimum col from cost_graph
-void subtract_minimum_column(Vec2D<float> &cost_graph, int nrows, int ncols)
+void subtract_minimum_column(MatrixView<float> cost_graph, int nrows, int ncols)
 {
   for (int j = 0; j < ncols; j++)
   {
@@ -62,7 +63,7 @@ void subtract_minimum_column(Vec2D<float> &cost_graph, int nrows, int ncols)
   }
 }
 
-void munkresStep1(Vec2D<float> &cost_graph, PairGraph &star_graph, int nrows,
+void munkresStep1(MatrixView<float> cost_graph, PairGraph &star_graph, int nrows,
                   int ncols)
 {
   for (int i = 0; i < nrows; i++)
@@ -94,7 +95,7 @@ bool munkresStep2(const PairGraph &star_graph, CoverTable &cover_table)
   return count >= k;
 }
 
-bool munkresStep3(Vec2D<float> &cost_graph, const PairGraph &star_graph,
+bool munkresStep3(MatrixView<float> cost_graph, const PairGraph &star_graph,
                   PairGraph &prime_graph, CoverTable &cover_table, std::pair<int, int> &p,
                   int nrows, int ncols)
 {
@@ -143,7 +144,7 @@ void munkresStep4(PairGraph &star_graph, PairGraph &prime_graph,
   prime_graph.clear();
 }
 
-void munkresStep5(Vec2D<float> &cost_graph, const CoverTable &cover_table,
+void munkresStep5(MatrixView<float> cost_graph, const CoverTable &cover_table,
                   int nrows, int ncols)
 {
   bool valid = false;
@@ -189,11 +190,15 @@ void munkresStep5(Vec2D<float> &cost_graph, const CoverTable &cover_table,
   }
 }
 
-void munkres_algorithm(Vec2D<float> &cost_graph, PairGraph &star_graph, int nrows,
-              int ncols)
+/* Solves the assignment using caller-owned scratch graphs, so repeated solves
+   on the same PairGraph/CoverTable instances never touch the heap. Returns the
+   number of step transitions it took. */
+int munkres_algorithm(MatrixView<float> cost_graph, PairGraph &star_graph,
+                      PairGraph &prime_graph, CoverTable &cover_table, int nrows,
+                      int ncols)
 {
-  PairGraph prime_graph(nrows, ncols);
-  CoverTable cover_table(nrows, ncols);
+  prime_graph.resize(nrows, ncols);
+  cover_table.resize(nrows, ncols);
   prime_graph.clear();
   cover_table.clear();
   star_graph.clear();
@@ -210,8 +215,10 @@ void munkres_algorithm(Vec2D<float> &cost_graph, PairGraph &star_graph, int nrow
 
   std::pair<int, int> p;
   bool done = false;
+  int iterations = 0;
   while (!done)
   {
+    iterations++;
     switch (step)
     {
     case 0:
@@ -241,4 +248,13 @@ void munkres_algorithm(Vec2D<float> &cost_graph, PairGraph &star_graph, int nrow
       break;
     }
   }
+  return iterations;
+}
+
+void munkres_algorithm(MatrixView<float> cost_graph, PairGraph &star_graph, int nrows,
+              int ncols)
+{
+  PairGraph prime_graph(nrows, ncols);
+  CoverTable cover_table(nrows, ncols);
+  munkres_algorithm(cost_graph, star_graph, prime_graph, cover_table, nrows, ncols);
 }
\ No newline at end of file
@@ -0,0 +1,49 @@
+// Copyright 2020 - NVIDIA Corporation
+// SPDX-License-Identifier: MIT
+
+/* Minimal stand-in for the nvinfer tensor output types used by the post-processing code,
+   so it can be built without DeepStream (POSE_POSTPROCESS_STANDALONE). The layouts of the
+   fields we use match nvdsinfer.h and gstnvdsinfer.h. */
+
+#pragma once
+
+#define NVDSINFER_MAX_DIMS 8
+
+typedef struct
+{
+  unsigned int numDims;
+  unsigned int d[NVDSINFER_MAX_DIMS];
+  unsigned int numElements;
+} NvDsInferDims;
+
+typedef enum
+{
+  FLOAT = 0,
+  HALF = 1,
+  INT8 = 2,
+  INT32 = 3
+} NvDsInferDataType;
+
+typedef struct
+{
+  NvDsInferDataType dataType;
+  union {
+    NvDsInferDims inferDims;
+    NvDsInferDims dims;
+  };
+  int bindingIndex;
+  const char *layerName;
+  void *buffer;
+  int isInput;
+} NvDsInferLayerInfo;
+
+typedef struct
+{
+  unsigned int unique_id;
+  unsigned int num_output_layers;
+  NvDsInferLayerInfo *output_layers_info;
+  void **out_buf_ptrs_host;
+  void **out_buf_ptrs_dev;
+  int gpu_id;
+  void *priv_data;
+} NvDsInferTensorMeta;
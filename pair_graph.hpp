@@ -6,12 +6,25 @@
 class PairGraph
 {
 public:
+  PairGraph() : nrows(0), ncols(0) {}
+
   PairGraph(int nrows, int ncols) : nrows(nrows), ncols(ncols)
   {
     this->rows.resize(nrows);
     this->cols.resize(ncols);
   }
 
+  /**
+   * Changes the graph shape, reusing the existing storage when it is large enough
+   */
+  void resize(int nrows, int ncols)
+  {
+    this->nrows = nrows;
+    this->ncols = ncols;
+    this->rows.resize(nrows);
+    this->cols.resize(ncols);
+  }
+
   /**
    * Returns the column index of the pair matching this row
    */
@@ -103,8 +116,8 @@ public:
     return p;
   }
 
-  const int nrows;
-  const int ncols;
+  int nrows;
+  int ncols;
 
 private:
   std::vector<int> rows;
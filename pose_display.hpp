@@ -0,0 +1,119 @@
+#pragma once
+
+#include "post_process_workspace.hpp"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "gstnvdsmeta.h"
+
+#include <algorithm>
+#include <vector>
+
+/**
+ * Builds the on-screen display metadata of a frame's poses: a circle on every
+ * part and a line along every link whose two parts were found.
+ *
+ * Every person is converted once to pixel positions and a mask of its parts,
+ * from which the visible links follow with one mask test each. Circles and
+ * lines are copied from templates into flat arrays first; only then are the
+ * display meta blocks acquired, exactly as many as the longer array needs,
+ * and filled a block-sized chunk at a time.
+ *
+ * The scratch arrays are reused across frames, so a builder must only be used
+ * by one thread at a time; the application builds on the streaming thread,
+ * where the meta pools may be touched.
+ */
+template <class Skeleton>
+class PoseDisplayBuilder
+{
+public:
+  static_assert(Skeleton::NUM_PARTS <= 32, "part masks are 32 bits wide");
+
+  PoseDisplayBuilder()
+  {
+    memset(&this->circle_template, 0, sizeof(this->circle_template));
+    this->circle_template.radius = 8;
+    this->circle_template.circle_color = NvOSD_ColorParams{244, 67, 54, 1};
+    this->circle_template.has_bg_color = 1;
+    this->circle_template.bg_color = NvOSD_ColorParams{0, 255, 0, 1};
+
+    memset(&this->line_template, 0, sizeof(this->line_template));
+    this->line_template.line_width = 3;
+    this->line_template.line_color = NvOSD_ColorParams{0, 255, 0, 1};
+
+    for (int k = 0; k < Skeleton::NUM_LINKS; k++)
+      this->link_masks[k] = (1u << Skeleton::links[k].part_a) | (1u << Skeleton::links[k].part_b);
+  }
+
+  /* Attaches the display meta of the people in 'workspace' to 'frame_meta', scaled to a frame
+     of 'frame_width' x 'frame_height' pixels */
+  void build(PostProcessWorkspace &workspace, NvDsFrameMeta *frame_meta, int frame_width, int frame_height)
+  {
+    this->circles.clear();
+    this->lines.clear();
+
+    for (int n = 0; n < workspace.num_objects; n++)
+    {
+      int *object = workspace.object(n);
+      uint32_t present = 0;
+      for (int c = 0; c < Skeleton::NUM_PARTS; c++)
+      {
+        if (object[c] < 0)
+          continue;
+        float *peak = workspace.refined_peak(c, object[c]);
+        this->x[c] = peak[1] * frame_width;
+        this->y[c] = peak[0] * frame_height;
+        present |= 1u << c;
+
+        this->circles.push_back(this->circle_template);
+        this->circles.back().xc = this->x[c];
+        this->circles.back().yc = this->y[c];
+      }
+
+      for (int k = 0; k < Skeleton::NUM_LINKS; k++)
+      {
+        if ((present & this->link_masks[k]) != this->link_masks[k])
+          continue;
+        const SkeletonLink &link = Skeleton::links[k];
+        this->lines.push_back(this->line_template);
+        NvOSD_LineParams &line = this->lines.back();
+        line.x1 = this->x[link.part_a];
+        line.y1 = this->y[link.part_a];
+        line.x2 = this->x[link.part_b];
+        line.y2 = this->y[link.part_b];
+      }
+    }
+
+    size_t num_circles = this->circles.size();
+    size_t num_lines = this->lines.size();
+    size_t num_blocks = (std::max(num_circles, num_lines) + MAX_ELEMENTS_IN_DISPLAY_META - 1) /
+                        MAX_ELEMENTS_IN_DISPLAY_META;
+    NvDsBatchMeta *bmeta = frame_meta->base_meta.batch_meta;
+    for (size_t b = 0; b < num_blocks; b++)
+    {
+      size_t first = b * MAX_ELEMENTS_IN_DISPLAY_META;
+      size_t block_circles = first < num_circles ? std::min(num_circles - first, (size_t)MAX_ELEMENTS_IN_DISPLAY_META) : 0;
+      size_t block_lines = first < num_lines ? std::min(num_lines - first, (size_t)MAX_ELEMENTS_IN_DISPLAY_META) : 0;
+
+      NvDsDisplayMeta *dmeta = nvds_acquire_display_meta_from_pool(bmeta);
+      if (block_circles)
+        memcpy(dmeta->circle_params, &this->circles[first], block_circles * sizeof(NvOSD_CircleParams));
+      if (block_lines)
+        memcpy(dmeta->line_params, &this->lines[first], block_lines * sizeof(NvOSD_LineParams));
+      dmeta->num_circles = block_circles;
+      dmeta->num_lines = block_lines;
+      nvds_add_display_meta_to_frame(frame_meta, dmeta);
+    }
+  }
+
+private:
+  NvOSD_CircleParams circle_template;
+  NvOSD_LineParams line_template;
+  uint32_t link_masks[Skeleton::NUM_LINKS];
+
+  int x[Skeleton::NUM_PARTS]; /* pixel position of every part of the current person */
+  int y[Skeleton::NUM_PARTS];
+  std::vector<NvOSD_CircleParams> circles;
+  std::vector<NvOSD_LineParams> lines;
+};
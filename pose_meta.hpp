@@ -0,0 +1,258 @@
+#pragma once
+
+#include "post_process_workspace.hpp"
+
+#include <glib.h>
+#include <string.h>
+
+#include "gstnvdsmeta.h"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+/* Registered with nvds_get_user_meta_type, consumers look the type up by this name */
+#define POSE_META_TYPE_NAME "NVIDIA.DEEPSTREAM.POSE_ESTIMATION"
+
+/* Keypoint in normalized frame coordinates, 'score' is its confidence map peak */
+struct PoseKeypoint
+{
+  float x;
+  float y;
+  float score; /* negative when the part was not found */
+};
+
+/**
+ * Poses of one frame, attached to its NvDsFrameMeta as NvDsUserMeta of type
+ * pose_meta_type(). The header and both arrays are a single block, so a
+ * consumer reads every person without further indirection:
+ *
+ *   keypoints(n)[c]    part 'c' of person 'n'
+ *   link_scores(n)[k]  PAF score of link 'k' of person 'n', negative when missing
+ *   track_id(n)        id of the person across frames, -1 when not tracked
+ *
+ * Part and link numbering is that of the skeleton named by 'skeleton'.
+ */
+struct PoseMeta
+{
+  const char *skeleton;
+  int num_parts;
+  int num_links;
+  int num_poses;
+  int capacity;          /* poses the block has room for */
+  size_t block_size;     /* bytes of the whole block, header included */
+  PoseKeypoint *keypoint_data;
+  float *link_score_data;
+  int *track_id_data;
+
+  inline PoseKeypoint *keypoints(int n)
+  {
+    return &keypoint_data[n * num_parts];
+  }
+
+  inline float *link_scores(int n)
+  {
+    return &link_score_data[n * num_links];
+  }
+
+  inline int *track_id(int n)
+  {
+    return &track_id_data[n];
+  }
+};
+
+/**
+ * Recycles PoseMeta blocks between frames. Released blocks go back to a free
+ * list and are handed out again as long as they are large enough, so in steady
+ * state attaching poses does not touch the heap.
+ */
+class PoseMetaPool
+{
+public:
+  PoseMetaPool() : max_free(DEFAULT_MAX_FREE) {}
+
+  ~PoseMetaPool()
+  {
+    for (PoseMeta *meta : this->free_list)
+      g_free(meta);
+  }
+
+  PoseMeta *acquire(int num_parts, int num_links, int num_poses)
+  {
+    size_t pose_size = num_parts * sizeof(PoseKeypoint) + num_links * sizeof(float) + sizeof(int);
+    size_t block_size = sizeof(PoseMeta) + num_poses * pose_size;
+
+    PoseMeta *meta = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (!this->free_list.empty())
+      {
+        meta = this->free_list.back();
+        this->free_list.pop_back();
+      }
+    }
+    if (meta && meta->block_size < block_size)
+    {
+      g_free(meta);
+      meta = nullptr;
+    }
+    if (!meta)
+    {
+      meta = (PoseMeta *)g_malloc(block_size);
+      meta->block_size = block_size;
+    }
+
+    meta->skeleton = nullptr;
+    meta->num_parts = num_parts;
+    meta->num_links = num_links;
+    meta->num_poses = 0;
+    meta->capacity = (meta->block_size - sizeof(PoseMeta)) / (pose_size ? pose_size : 1);
+    meta->keypoint_data = (PoseKeypoint *)(meta + 1);
+    meta->link_score_data = (float *)(meta->keypoint_data + meta->capacity * num_parts);
+    meta->track_id_data = (int *)(meta->link_score_data + meta->capacity * num_links);
+    return meta;
+  }
+
+  void release(PoseMeta *meta)
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (this->free_list.size() < this->max_free)
+      {
+        this->free_list.push_back(meta);
+        return;
+      }
+    }
+    g_free(meta);
+  }
+
+  /* Keeps at least 'blocks' released blocks, for users that hold that many at once */
+  void reserveFree(size_t blocks)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->max_free = std::max(this->max_free, blocks);
+  }
+
+private:
+  static const size_t DEFAULT_MAX_FREE = 64;
+
+  std::mutex mutex;
+  std::vector<PoseMeta *> free_list;
+  size_t max_free;
+};
+
+inline PoseMetaPool &pose_meta_pool()
+{
+  static PoseMetaPool pool;
+  return pool;
+}
+
+inline NvDsMetaType pose_meta_type()
+{
+  static NvDsMetaType type = nvds_get_user_meta_type((gchar *)POSE_META_TYPE_NAME);
+  return type;
+}
+
+/* Copies 'src' into a block of the pool, hand it back with pose_meta_pool().release() */
+inline PoseMeta *
+pose_meta_duplicate(PoseMeta *src)
+{
+  PoseMeta *dst = pose_meta_pool().acquire(src->num_parts, src->num_links, src->num_poses);
+
+  dst->skeleton = src->skeleton;
+  dst->num_poses = src->num_poses;
+  for (int n = 0; n < src->num_poses; n++)
+  {
+    memcpy(dst->keypoints(n), src->keypoints(n), src->num_parts * sizeof(PoseKeypoint));
+    memcpy(dst->link_scores(n), src->link_scores(n), src->num_links * sizeof(float));
+    *dst->track_id(n) = *src->track_id(n);
+  }
+  return dst;
+}
+
+/* NvDsMetaCopyFunc, deep copies the block when the batch meta is copied */
+inline gpointer
+pose_meta_copy(gpointer data, gpointer user_data)
+{
+  NvDsUserMeta *user_meta = (NvDsUserMeta *)data;
+  return pose_meta_duplicate((PoseMeta *)user_meta->user_meta_data);
+}
+
+/* NvDsMetaReleaseFunc, hands the block back to the pool */
+inline void
+pose_meta_release(gpointer data, gpointer user_data)
+{
+  NvDsUserMeta *user_meta = (NvDsUserMeta *)data;
+  pose_meta_pool().release((PoseMeta *)user_meta->user_meta_data);
+  user_meta->user_meta_data = NULL;
+}
+
+/* Returns the poses attached to 'frame_meta', NULL when there are none */
+inline PoseMeta *
+find_pose_meta(NvDsFrameMeta *frame_meta)
+{
+  for (NvDsMetaList *l_user = frame_meta->frame_user_meta_list; l_user != NULL;
+       l_user = l_user->next)
+  {
+    NvDsUserMeta *user_meta = (NvDsUserMeta *)l_user->data;
+    if (user_meta->base_meta.meta_type == pose_meta_type())
+      return (PoseMeta *)user_meta->user_meta_data;
+  }
+  return NULL;
+}
+
+/* Copies the people found by the post-processing into a pooled PoseMeta and attaches it to
+   'frame_meta'. Must run on the thread owning the batch meta, like the display meta. */
+template <class Skeleton>
+PoseMeta *
+attach_pose_meta(PostProcessWorkspace &workspace, NvDsFrameMeta *frame_meta)
+{
+  const int C = Skeleton::NUM_PARTS;
+  const int K = Skeleton::NUM_LINKS;
+  int num_poses = workspace.num_objects;
+
+  PoseMeta *meta = pose_meta_pool().acquire(C, K, num_poses);
+  meta->skeleton = Skeleton::NAME;
+  meta->num_poses = num_poses;
+
+  for (int n = 0; n < num_poses; n++)
+  {
+    int *object = workspace.object(n);
+    PoseKeypoint *keypoints = meta->keypoints(n);
+    *meta->track_id(n) = -1;
+    for (int c = 0; c < C; c++)
+    {
+      int p = object[c];
+      if (p >= 0)
+      {
+        float *peak = workspace.refined_peak(c, p);
+        keypoints[c] = {peak[1], peak[0], workspace.peak_score(c, p)};
+      }
+      else
+      {
+        keypoints[c] = {0.0f, 0.0f, -1.0f};
+      }
+    }
+
+    /* Both ends of a link can also belong to the person through other links, then the
+       link itself has no score */
+    float *link_scores = meta->link_scores(n);
+    for (int k = 0; k < K; k++)
+    {
+      int a = object[Skeleton::links[k].part_a];
+      int b = object[Skeleton::links[k].part_b];
+      if (a >= 0 && b >= 0 && workspace.connection(k, 0)[a] == b)
+        link_scores[k] = workspace.score_graph(k)[a][b];
+      else
+        link_scores[k] = -1.0f;
+    }
+  }
+
+  NvDsUserMeta *user_meta = nvds_acquire_user_meta_from_pool(frame_meta->base_meta.batch_meta);
+  user_meta->user_meta_data = meta;
+  user_meta->base_meta.meta_type = pose_meta_type();
+  user_meta->base_meta.copy_func = pose_meta_copy;
+  user_meta->base_meta.release_func = pose_meta_release;
+  nvds_add_user_meta_to_frame(frame_meta, user_meta);
+  return meta;
+}
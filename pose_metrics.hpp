@@ -0,0 +1,290 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* Stages with a latency histogram, probes included */
+enum PoseMetricStage
+{
+  METRIC_PGIE_PROBE,
+  METRIC_ATTACH_PROBE,
+  METRIC_FIND_PEAKS,
+  METRIC_REFINE_PEAKS,
+  METRIC_PAF_SCORE_GRAPH,
+  METRIC_ASSIGNMENT,
+  METRIC_CONNECT_PARTS,
+  METRIC_CREATE_DISPLAY_META,
+  METRIC_GLASS_TO_POSE, /* live sources: from the frame's PTS to its poses being attached */
+  NUM_METRIC_STAGES
+};
+
+static const char *metric_stage_names[NUM_METRIC_STAGES] = {
+    "pgie_probe", "attach_probe", "find_peaks", "refine_peaks",
+    "paf_score_graph", "assignment", "connect_parts", "create_display_meta", "glass_to_pose"};
+
+/* Bucket b holds durations up to 2^b microseconds, the last one everything longer */
+#define METRIC_NUM_BUCKETS 21
+#define METRIC_MAX_CHANNELS 32
+
+/**
+ * Counters of one thread. Only the owning thread writes them, so an update is
+ * a relaxed load and store without any read-modify-write; the dump reads them
+ * concurrently with relaxed loads.
+ */
+struct ThreadMetrics
+{
+  std::atomic<uint64_t> buckets[NUM_METRIC_STAGES][METRIC_NUM_BUCKETS];
+  std::atomic<uint64_t> sum_ns[NUM_METRIC_STAGES];
+  std::atomic<uint64_t> peaks[METRIC_MAX_CHANNELS];
+  std::atomic<uint64_t> frames;
+  std::atomic<uint64_t> persons;
+  std::atomic<uint64_t> munkres_iterations;
+
+  static inline void add(std::atomic<uint64_t> &counter, uint64_t value)
+  {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+  }
+
+  void record(PoseMetricStage stage, int64_t ns)
+  {
+    uint64_t us = ns > 0 ? (uint64_t)(ns + 999) / 1000 : 0;
+    int bucket = us <= 1 ? 0 : 64 - __builtin_clzll(us - 1);
+    if (bucket >= METRIC_NUM_BUCKETS)
+      bucket = METRIC_NUM_BUCKETS - 1;
+    add(this->buckets[stage][bucket], 1);
+    add(this->sum_ns[stage], ns > 0 ? ns : 0);
+  }
+};
+
+/**
+ * Latency histograms and counters of the post-processing, kept per thread and
+ * summed when they are dumped in the Prometheus text format. Every thread
+ * registers its block on first use, which is the only time a lock is taken on
+ * the recording side. Blocks outlive their threads so no count is lost.
+ *
+ * Recording is off until enable() is called; disabled, the instrumented code
+ * does not even read the clock.
+ */
+class PoseMetrics
+{
+public:
+  PoseMetrics()
+      : enabled(false), part_names(nullptr), num_parts(0), governor_level(-1), governor_changes(0) {}
+
+  void enable()
+  {
+    this->enabled.store(true, std::memory_order_relaxed);
+  }
+
+  inline bool isEnabled() const
+  {
+    return this->enabled.load(std::memory_order_relaxed);
+  }
+
+  /* Labels the per-channel peak counters with the skeleton's part names */
+  void setPartNames(const char *const *part_names, int num_parts)
+  {
+    this->part_names = part_names;
+    this->num_parts = num_parts;
+  }
+
+  /* Current level of the quality governor and its level changes so far */
+  void setGovernorLevel(int level, long changes)
+  {
+    this->governor_level.store(level, std::memory_order_relaxed);
+    this->governor_changes.store(changes, std::memory_order_relaxed);
+  }
+
+  /* Counters of the calling thread */
+  inline ThreadMetrics &local()
+  {
+    static thread_local ThreadMetrics *metrics = nullptr;
+    if (!metrics)
+      metrics = registerThread();
+    return *metrics;
+  }
+
+  /**
+   * Writes the summed counters to 'path' in the Prometheus text format. The
+   * file is written next to 'path' and renamed over it, so a scraper never
+   * reads a partial dump.
+   */
+  bool dump(const char *path)
+  {
+    std::string tmp_path = std::string(path) + ".tmp";
+    FILE *file = fopen(tmp_path.c_str(), "w");
+    if (!file)
+      return false;
+
+    ThreadMetrics total{};
+    sum(total);
+
+    fprintf(file, "# HELP pose_stage_duration_seconds Time spent per frame in a stage, summed over threads\n"
+                  "# TYPE pose_stage_duration_seconds histogram\n");
+    for (int s = 0; s < NUM_METRIC_STAGES; s++)
+    {
+      uint64_t count = 0;
+      for (int b = 0; b < METRIC_NUM_BUCKETS; b++)
+      {
+        count += total.buckets[s][b].load(std::memory_order_relaxed);
+        if (b < METRIC_NUM_BUCKETS - 1)
+          fprintf(file, "pose_stage_duration_seconds_bucket{stage=\"%s\",le=\"%g\"} %llu\n",
+                  metric_stage_names[s], (double)(1ull << b) * 1e-6, (unsigned long long)count);
+        else
+          fprintf(file, "pose_stage_duration_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %llu\n",
+                  metric_stage_names[s], (unsigned long long)count);
+      }
+      fprintf(file, "pose_stage_duration_seconds_sum{stage=\"%s\"} %.9f\n", metric_stage_names[s],
+              total.sum_ns[s].load(std::memory_order_relaxed) * 1e-9);
+      fprintf(file, "pose_stage_duration_seconds_count{stage=\"%s\"} %llu\n", metric_stage_names[s],
+              (unsigned long long)count);
+    }
+
+    fprintf(file, "# HELP pose_peaks_total Confidence map peaks found per part\n"
+                  "# TYPE pose_peaks_total counter\n");
+    int num_channels = this->part_names ? this->num_parts : METRIC_MAX_CHANNELS;
+    for (int c = 0; c < num_channels && c < METRIC_MAX_CHANNELS; c++)
+    {
+      uint64_t peaks = total.peaks[c].load(std::memory_order_relaxed);
+      if (this->part_names)
+        fprintf(file, "pose_peaks_total{part=\"%s\"} %llu\n", this->part_names[c],
+                (unsigned long long)peaks);
+      else if (peaks)
+        fprintf(file, "pose_peaks_total{part=\"%d\"} %llu\n", c, (unsigned long long)peaks);
+    }
+
+    fprintf(file, "# HELP pose_frames_total Frames post-processed\n"
+                  "# TYPE pose_frames_total counter\n"
+                  "pose_frames_total %llu\n"
+                  "# HELP pose_persons_total Persons found, divide by pose_frames_total for persons per frame\n"
+                  "# TYPE pose_persons_total counter\n"
+                  "pose_persons_total %llu\n"
+                  "# HELP pose_munkres_iterations_total Step transitions of the Munkres solver\n"
+                  "# TYPE pose_munkres_iterations_total counter\n"
+                  "pose_munkres_iterations_total %llu\n",
+            (unsigned long long)total.frames.load(std::memory_order_relaxed),
+            (unsigned long long)total.persons.load(std::memory_order_relaxed),
+            (unsigned long long)total.munkres_iterations.load(std::memory_order_relaxed));
+
+    int governor_level = this->governor_level.load(std::memory_order_relaxed);
+    if (governor_level >= 0)
+    {
+      fprintf(file, "# HELP pose_governor_level Quality level of the post-processing, 0 is full quality\n"
+                    "# TYPE pose_governor_level gauge\n"
+                    "pose_governor_level %d\n"
+                    "# HELP pose_governor_level_changes_total Quality level changes of the governor\n"
+                    "# TYPE pose_governor_level_changes_total counter\n"
+                    "pose_governor_level_changes_total %ld\n",
+              governor_level, this->governor_changes.load(std::memory_order_relaxed));
+    }
+
+    bool ok = !ferror(file);
+    ok = fclose(file) == 0 && ok;
+    return ok && rename(tmp_path.c_str(), path) == 0;
+  }
+
+private:
+  ThreadMetrics *registerThread()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->threads.emplace_back(new ThreadMetrics());
+    return this->threads.back().get();
+  }
+
+  void sum(ThreadMetrics &total)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    for (auto &metrics : this->threads)
+    {
+      for (int s = 0; s < NUM_METRIC_STAGES; s++)
+      {
+        for (int b = 0; b < METRIC_NUM_BUCKETS; b++)
+          ThreadMetrics::add(total.buckets[s][b], metrics->buckets[s][b].load(std::memory_order_relaxed));
+        ThreadMetrics::add(total.sum_ns[s], metrics->sum_ns[s].load(std::memory_order_relaxed));
+      }
+      for (int c = 0; c < METRIC_MAX_CHANNELS; c++)
+        ThreadMetrics::add(total.peaks[c], metrics->peaks[c].load(std::memory_order_relaxed));
+      ThreadMetrics::add(total.frames, metrics->frames.load(std::memory_order_relaxed));
+      ThreadMetrics::add(total.persons, metrics->persons.load(std::memory_order_relaxed));
+      ThreadMetrics::add(total.munkres_iterations,
+                         metrics->munkres_iterations.load(std::memory_order_relaxed));
+    }
+  }
+
+  std::atomic<bool> enabled;
+  const char *const *part_names;
+  int num_parts;
+  std::atomic<int> governor_level; /* -1 without governor */
+  std::atomic<long> governor_changes;
+
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadMetrics>> threads;
+};
+
+inline PoseMetrics &pose_metrics()
+{
+  static PoseMetrics metrics;
+  return metrics;
+}
+
+/**
+ * Splits the time of a thread into stages. Reads the clock only while metrics
+ * are enabled; split() then returns -1 and lap() records nothing.
+ */
+class StageClock
+{
+public:
+  StageClock() : last(pose_metrics().isEnabled() ? now() : -1) {}
+
+  /* Nanoseconds since construction or the previous split */
+  inline int64_t split()
+  {
+    if (this->last < 0)
+      return -1;
+    int64_t time = now();
+    int64_t elapsed = time - this->last;
+    this->last = time;
+    return elapsed;
+  }
+
+  /* Records the time since the previous split as one sample of 'stage' */
+  inline void lap(PoseMetricStage stage)
+  {
+    int64_t elapsed = split();
+    if (elapsed >= 0)
+      pose_metrics().local().record(stage, elapsed);
+  }
+
+private:
+  static inline int64_t now()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  int64_t last;
+};
+
+/* Times the enclosing scope as one sample of 'stage' */
+class ScopedStageTimer
+{
+public:
+  explicit ScopedStageTimer(PoseMetricStage stage) : stage(stage) {}
+
+  ~ScopedStageTimer()
+  {
+    this->clock.lap(this->stage);
+  }
+
+private:
+  PoseMetricStage stage;
+  StageClock clock;
+};
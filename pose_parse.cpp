@@ -0,0 +1,261 @@
+// Copyright 2020 - NVIDIA Corporation
+// SPDX-License-Identifier: MIT
+
+/* libposeparse, the C interface of pose_parse.h over the post-processing of post_process.cpp.
+   Built with POSE_POSTPROCESS_STANDALONE and hidden visibility, so only the pose_parse_*
+   functions are exported. */
+
+#include "pose_parse.h"
+#include "post_process.cpp"
+
+#include <memory>
+#include <new>
+
+struct PoseParseContext
+{
+  SkeletonType skeleton;
+  PostProcessWorkspace workspace;
+  PeakSearchState search_state;
+  std::unique_ptr<TaskScheduler> scheduler;
+};
+
+/* Checks 'in' like the post-processing config of the app and converts it */
+static bool
+convert_params(const PoseParseParams &in, PostProcessParams &out)
+{
+  if (in.threshold <= 0.0f || in.threshold >= 1.0f || in.link_threshold < 0.0f || in.window_size < 1 ||
+      in.window_size % 2 == 0 || in.max_num_parts < 1 || in.num_integral_samples < 2 ||
+      in.max_num_objects < 1 || in.paf_sample_spacing < 0.0f || in.full_scan_interval < 0 ||
+      in.search_radius < 0 || in.search_energy_change < 0.0f)
+  {
+    return false;
+  }
+  if (in.peak_detector < PEAK_DETECTOR_WINDOW || in.peak_detector > PEAK_DETECTOR_PYRAMID ||
+      in.solver < ASSIGNMENT_SOLVER_MUNKRES || in.solver > ASSIGNMENT_SOLVER_GREEDY ||
+      in.paf_sampling < PAF_SAMPLING_NEAREST || in.paf_sampling > PAF_SAMPLING_BILINEAR)
+  {
+    return false;
+  }
+
+  out.threshold = in.threshold;
+  out.window_size = in.window_size;
+  out.max_num_parts = in.max_num_parts;
+  out.num_integral_samples = in.num_integral_samples;
+  out.link_threshold = in.link_threshold;
+  out.max_num_objects = in.max_num_objects;
+  out.peak_detector = (PeakDetector)in.peak_detector;
+  out.solver = (AssignmentSolverType)in.solver;
+  out.prune_links = in.prune_links != 0;
+  out.paf_sampling = (PafSampling)in.paf_sampling;
+  out.paf_sample_spacing = in.paf_sample_spacing;
+  out.full_scan_interval = in.full_scan_interval;
+  out.search_radius = in.search_radius;
+  out.search_energy_change = in.search_energy_change;
+  return true;
+}
+
+static NvDsInferDims
+tensor_dims(const PoseParseTensor &tensor)
+{
+  NvDsInferDims dims = {};
+  dims.numDims = 3;
+  dims.d[0] = tensor.channels;
+  dims.d[1] = tensor.height;
+  dims.d[2] = tensor.width;
+  dims.numElements = tensor.channels * tensor.height * tensor.width;
+  return dims;
+}
+
+static TensorFormat
+tensor_format(const PoseParseTensor &tensor)
+{
+  TensorFormat format;
+  format.data_type = (NvDsInferDataType)tensor.data_type;
+  format.int8_scale = tensor.int8_scale;
+  return format;
+}
+
+/* Runs the post-processing and copies the poses out the way attach_pose_meta does */
+template <class Skeleton>
+static int
+run_context(PoseParseContext &context, const PoseParseTensor &cmap, const PoseParseTensor &paf,
+            const PostProcessParams &params, PoseParseKeypoint *keypoints, float *link_scores,
+            int max_poses)
+{
+  const int C = Skeleton::NUM_PARTS;
+  const int K = Skeleton::NUM_LINKS;
+  if (cmap.channels != C || paf.channels != 2 * K || cmap.height != paf.height || cmap.width != paf.width)
+    return POSE_PARSE_ERROR_SHAPE;
+
+  NvDsInferDims cmap_dims = tensor_dims(cmap);
+  NvDsInferDims paf_dims = tensor_dims(paf);
+  PostProcessWorkspace &workspace = context.workspace;
+  workspace.reserve(C, K, cmap.height, cmap.width, params.max_num_parts, params.max_num_objects);
+  int num_poses = run_post_process<Skeleton>(workspace, context.scheduler.get(), (void *)cmap.data,
+                                             cmap_dims, (void *)paf.data, paf_dims, params,
+                                             &context.search_state, tensor_format(cmap),
+                                             tensor_format(paf));
+
+  for (int n = 0; n < num_poses && n < max_poses; n++)
+  {
+    int *object = workspace.object(n);
+    for (int c = 0; c < C; c++)
+    {
+      int p = object[c];
+      if (p >= 0)
+      {
+        float *peak = workspace.refined_peak(c, p);
+        keypoints[n * C + c] = {peak[1], peak[0], workspace.peak_score(c, p)};
+      }
+      else
+      {
+        keypoints[n * C + c] = {0.0f, 0.0f, -1.0f};
+      }
+    }
+
+    if (!link_scores)
+      continue;
+    for (int k = 0; k < K; k++)
+    {
+      int a = object[Skeleton::links[k].part_a];
+      int b = object[Skeleton::links[k].part_b];
+      if (a >= 0 && b >= 0 && workspace.connection(k, 0)[a] == b)
+        link_scores[n * K + k] = workspace.score_graph(k)[a][b];
+      else
+        link_scores[n * K + k] = -1.0f;
+    }
+  }
+  return num_poses;
+}
+
+extern "C" {
+
+void pose_parse_default_params(PoseParseParams *params)
+{
+  if (!params)
+    return;
+  PostProcessParams defaults;
+  params->threshold = defaults.threshold;
+  params->window_size = defaults.window_size;
+  params->max_num_parts = defaults.max_num_parts;
+  params->num_integral_samples = defaults.num_integral_samples;
+  params->link_threshold = defaults.link_threshold;
+  params->max_num_objects = defaults.max_num_objects;
+  params->peak_detector = defaults.peak_detector;
+  params->solver = defaults.solver;
+  params->prune_links = defaults.prune_links;
+  params->paf_sampling = defaults.paf_sampling;
+  params->paf_sample_spacing = defaults.paf_sample_spacing;
+  params->full_scan_interval = defaults.full_scan_interval;
+  params->search_radius = defaults.search_radius;
+  params->search_energy_change = defaults.search_energy_change;
+}
+
+PoseParseContext *pose_parse_create(PoseParseSkeleton skeleton, int num_threads)
+{
+  if ((skeleton != POSE_PARSE_SKELETON_BODY && skeleton != POSE_PARSE_SKELETON_HAND) || num_threads < 0)
+    return NULL;
+  try
+  {
+    std::unique_ptr<PoseParseContext> context(new PoseParseContext());
+    context->skeleton = skeleton == POSE_PARSE_SKELETON_HAND ? SKELETON_HAND : SKELETON_BODY;
+    if (num_threads > 0)
+      context->scheduler.reset(new TaskScheduler(num_threads));
+    return context.release();
+  }
+  catch (...)
+  {
+    return NULL;
+  }
+}
+
+void pose_parse_destroy(PoseParseContext *context)
+{
+  delete context;
+}
+
+int pose_parse_num_parts(const PoseParseContext *context)
+{
+  if (!context)
+    return POSE_PARSE_ERROR_INVALID_ARGUMENT;
+  return context->skeleton == SKELETON_HAND ? HandSkeleton::NUM_PARTS : BodySkeleton::NUM_PARTS;
+}
+
+int pose_parse_num_links(const PoseParseContext *context)
+{
+  if (!context)
+    return POSE_PARSE_ERROR_INVALID_ARGUMENT;
+  return context->skeleton == SKELETON_HAND ? HandSkeleton::NUM_LINKS : BodySkeleton::NUM_LINKS;
+}
+
+const char *pose_parse_part_name(const PoseParseContext *context, int part)
+{
+  if (part < 0 || part >= pose_parse_num_parts(context))
+    return NULL;
+  return context->skeleton == SKELETON_HAND ? HandSkeleton::part_names[part] : BodySkeleton::part_names[part];
+}
+
+int pose_parse_link_parts(const PoseParseContext *context, int link, int *part_a, int *part_b)
+{
+  if (link < 0 || link >= pose_parse_num_links(context) || !part_a || !part_b)
+    return POSE_PARSE_ERROR_INVALID_ARGUMENT;
+  const SkeletonLink &skeleton_link =
+      context->skeleton == SKELETON_HAND ? HandSkeleton::links[link] : BodySkeleton::links[link];
+  *part_a = skeleton_link.part_a;
+  *part_b = skeleton_link.part_b;
+  return POSE_PARSE_OK;
+}
+
+int pose_parse_run(PoseParseContext *context, const PoseParseTensor *cmap, const PoseParseTensor *paf,
+                   const PoseParseParams *params, PoseParseKeypoint *keypoints, float *link_scores,
+                   int max_poses)
+{
+  PostProcessParams post_process_params;
+  if (!context || !cmap || !paf || !params || !cmap->data || !paf->data || max_poses < 0 ||
+      (max_poses > 0 && !keypoints) || cmap->height < 1 || cmap->width < 1 ||
+      !convert_params(*params, post_process_params) ||
+      (cmap->data_type == POSE_PARSE_INT8 && cmap->int8_scale <= 0.0f) ||
+      (paf->data_type == POSE_PARSE_INT8 && paf->int8_scale <= 0.0f))
+  {
+    return POSE_PARSE_ERROR_INVALID_ARGUMENT;
+  }
+  if (!tensor_data_type_supported((NvDsInferDataType)cmap->data_type) ||
+      !tensor_data_type_supported((NvDsInferDataType)paf->data_type))
+  {
+    return POSE_PARSE_ERROR_DATA_TYPE;
+  }
+
+  try
+  {
+    if (context->skeleton == SKELETON_HAND)
+      return run_context<HandSkeleton>(*context, *cmap, *paf, post_process_params, keypoints, link_scores,
+                                       max_poses);
+    return run_context<BodySkeleton>(*context, *cmap, *paf, post_process_params, keypoints, link_scores,
+                                     max_poses);
+  }
+  catch (...)
+  {
+    return POSE_PARSE_ERROR_INTERNAL;
+  }
+}
+
+const char *pose_parse_status_string(int status)
+{
+  if (status >= 0)
+    return "success";
+  switch (status)
+  {
+  case POSE_PARSE_ERROR_INVALID_ARGUMENT:
+    return "invalid argument";
+  case POSE_PARSE_ERROR_SHAPE:
+    return "tensor channels do not match the skeleton";
+  case POSE_PARSE_ERROR_DATA_TYPE:
+    return "unsupported tensor data type";
+  case POSE_PARSE_ERROR_INTERNAL:
+    return "internal error";
+  default:
+    return "unknown status";
+  }
+}
+
+}
@@ -0,0 +1,131 @@
+// Copyright 2020 - NVIDIA Corporation
+// SPDX-License-Identifier: MIT
+
+/* C interface of libposeparse, the pose post-processing of this app as a library. It turns
+   the cmap and paf outputs of a pose network into skeletons, with the same kernels, solvers
+   and threading as the app, and depends on neither DeepStream nor GStreamer.
+
+   A context holds the buffers of one stream and is reused frame after frame; it must only be
+   used by one thread at a time. Tensors are read in place, results are written to buffers
+   the caller owns. Build with 'make libposeparse.a' or 'make libposeparse.so'. */
+
+#ifndef POSE_PARSE_H
+#define POSE_PARSE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define POSE_PARSE_API __attribute__((visibility("default")))
+#else
+#define POSE_PARSE_API
+#endif
+
+typedef struct PoseParseContext PoseParseContext;
+
+typedef enum
+{
+  POSE_PARSE_SKELETON_BODY = 0, /* 18 keypoint COCO body model */
+  POSE_PARSE_SKELETON_HAND = 1  /* 21 keypoint hand model */
+} PoseParseSkeleton;
+
+/* Element types of a tensor, numbered like NvDsInferDataType */
+typedef enum
+{
+  POSE_PARSE_FLOAT = 0,
+  POSE_PARSE_HALF = 1,
+  POSE_PARSE_INT8 = 2
+} PoseParseDataType;
+
+/* Return codes, every failure is negative */
+typedef enum
+{
+  POSE_PARSE_OK = 0,
+  POSE_PARSE_ERROR_INVALID_ARGUMENT = -1,
+  POSE_PARSE_ERROR_SHAPE = -2,     /* channel counts do not match the skeleton */
+  POSE_PARSE_ERROR_DATA_TYPE = -3, /* element type not supported */
+  POSE_PARSE_ERROR_INTERNAL = -4   /* out of memory or another internal failure */
+} PoseParseStatus;
+
+/* A network output in CHW order. 'int8_scale' is the value of one quantization step of INT8
+   tensors and unused by the other types. */
+typedef struct
+{
+  const void *data;
+  PoseParseDataType data_type;
+  float int8_scale;
+  int channels;
+  int height;
+  int width;
+} PoseParseTensor;
+
+/* Tunables of the post-processing, see PostProcessParams. Enumerations are numbered in the
+   order of the app's option values: peak_detector window, separable, compact, pyramid;
+   solver munkres, lapjv, greedy; paf_sampling nearest, bilinear. */
+typedef struct
+{
+  float threshold;
+  int window_size;
+  int max_num_parts;
+  int num_integral_samples;
+  float link_threshold;
+  int max_num_objects;
+  int peak_detector;
+  int solver;
+  int prune_links;
+  int paf_sampling;
+  float paf_sample_spacing;
+  int full_scan_interval;
+  int search_radius;
+  float search_energy_change;
+} PoseParseParams;
+
+/* Keypoint in normalized frame coordinates, 'score' is its confidence map peak */
+typedef struct
+{
+  float x;
+  float y;
+  float score; /* negative when the part was not found */
+} PoseParseKeypoint;
+
+/* Fills 'params' with the defaults of the app */
+POSE_PARSE_API void pose_parse_default_params(PoseParseParams *params);
+
+/* Creates a context for 'skeleton' that post-processes on 'num_threads' extra threads, 0 runs
+   on the calling thread. Returns NULL on failure. */
+POSE_PARSE_API PoseParseContext *pose_parse_create(PoseParseSkeleton skeleton, int num_threads);
+
+POSE_PARSE_API void pose_parse_destroy(PoseParseContext *context);
+
+/* Keypoints and links per pose of the context's skeleton */
+POSE_PARSE_API int pose_parse_num_parts(const PoseParseContext *context);
+POSE_PARSE_API int pose_parse_num_links(const PoseParseContext *context);
+
+/* Name of 'part', NULL when out of range */
+POSE_PARSE_API const char *pose_parse_part_name(const PoseParseContext *context, int part);
+
+/* Parts joined by 'link', returns POSE_PARSE_ERROR_INVALID_ARGUMENT when out of range */
+POSE_PARSE_API int pose_parse_link_parts(const PoseParseContext *context, int link, int *part_a, int *part_b);
+
+/**
+ * Post-processes one frame. Pose n is written to keypoints[n * num_parts] and,
+ * when 'link_scores' is not NULL, its PAF link scores to link_scores[n * num_links],
+ * negative for missing links. Returns the number of poses found, of which only
+ * the first 'max_poses' are written, or a negative PoseParseStatus.
+ *
+ * With 'full_scan_interval' set, consecutive calls are treated as consecutive
+ * frames of one stream.
+ */
+POSE_PARSE_API int pose_parse_run(PoseParseContext *context, const PoseParseTensor *cmap,
+                                  const PoseParseTensor *paf, const PoseParseParams *params,
+                                  PoseParseKeypoint *keypoints, float *link_scores, int max_poses);
+
+/* Description of a PoseParseStatus */
+POSE_PARSE_API const char *pose_parse_status_string(int status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
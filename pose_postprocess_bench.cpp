@@ -0,0 +1,506 @@
+// Copyright 2020 - NVIDIA Corporation
+// SPDX-License-Identifier: MIT
+
+/* Offline benchmark of the pose post-processing. Loads recorded cmap/paf tensors and measures
+   every stage from 'find_peaks' to 'connect_parts' on the CPU, without GStreamer, DeepStream
+   or a GPU. Build with 'make pose-postprocess-bench'. */
+
+#include "post_process.cpp"
+#include "tensor_capture.hpp"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock bench_clock;
+
+/* A recorded frame, raw tensor files are little-endian float32 in CHW order and converted to
+   the benchmarked element type on load. Frames replayed from a tensor capture point into the
+   mapped file instead of owning a copy. */
+struct BenchFrame
+{
+  void *cmap;
+  void *paf;
+  int stream; /* dense index of the frame's source, tensor files are all one stream */
+  std::vector<uint8_t> cmap_storage;
+  std::vector<uint8_t> paf_storage;
+};
+
+enum BenchStage
+{
+  STAGE_FIND_PEAKS = 0,
+  STAGE_REFINE_PEAKS,
+  STAGE_PAF_SCORE_GRAPH,
+  STAGE_ASSIGNMENT,
+  STAGE_CONNECT_PARTS,
+  STAGE_END_TO_END,
+  NUM_STAGES
+};
+
+static const char *stage_names[NUM_STAGES] = {
+    "find_peaks", "refine_peaks", "paf_score_graph", "assignment", "connect_parts", "end_to_end"};
+
+static bool
+parse_dims(const char *text, NvDsInferDims &dims)
+{
+  unsigned int c, h, w;
+  if (sscanf(text, "%u,%u,%u", &c, &h, &w) != 3 || !c || !h || !w)
+    return false;
+  dims.numDims = 3;
+  dims.d[0] = c;
+  dims.d[1] = h;
+  dims.d[2] = w;
+  dims.numElements = c * h * w;
+  return true;
+}
+
+static bool
+parse_int_list(const char *text, std::vector<int> &values)
+{
+  values.clear();
+  const char *p = text;
+  while (*p)
+  {
+    char *end;
+    long value = strtol(p, &end, 10);
+    if (end == p || value < 0)
+      return false;
+    values.push_back((int)value);
+    p = *end == ',' ? end + 1 : end;
+  }
+  return !values.empty();
+}
+
+static bool
+data_type_from_string(const char *name, NvDsInferDataType &data_type)
+{
+  if (!strcmp(name, "float"))
+    data_type = FLOAT;
+  else if (!strcmp(name, "half"))
+    data_type = HALF;
+  else if (!strcmp(name, "int8"))
+    data_type = INT8;
+  else
+    return false;
+  return true;
+}
+
+/* Rounds to the nearest half, ties to even */
+static uint16_t
+float_to_half(float value)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint16_t sign = (bits >> 16) & 0x8000;
+  int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  if (exponent >= 31)
+    return sign | 0x7c00;
+  int shift = 13;
+  if (exponent <= 0)
+  {
+    if (exponent < -10)
+      return sign;
+    mantissa |= 0x800000;
+    shift = 14 - exponent;
+    exponent = 0;
+  }
+  uint32_t half = mantissa >> shift;
+  uint32_t rest = mantissa & ((1u << shift) - 1);
+  uint32_t tie = 1u << (shift - 1);
+  /* A carry out of the mantissa correctly moves on to the next exponent */
+  uint32_t result = ((uint32_t)exponent << 10) + half + (rest > tie || (rest == tie && (half & 1)));
+  return sign | (uint16_t)result;
+}
+
+/* Stores float32 'values' as the element type of 'format' */
+static void
+convert_tensor(const std::vector<float> &values, const TensorFormat &format, std::vector<uint8_t> &data)
+{
+  data.resize(values.size() * tensor_capture_element_size(format.data_type));
+  for (size_t i = 0; i < values.size(); i++)
+  {
+    if (format.data_type == HALF)
+    {
+      uint16_t half = float_to_half(values[i]);
+      memcpy(&data[i * 2], &half, sizeof(half));
+    }
+    else if (format.data_type == INT8)
+    {
+      float q = roundf(values[i] / format.int8_scale);
+      data[i] = (uint8_t)(int8_t)std::max(-127.0f, std::min(127.0f, q));
+    }
+    else
+    {
+      memcpy(&data[i * 4], &values[i], sizeof(float));
+    }
+  }
+}
+
+static bool
+load_tensor(const char *path, NvDsInferDims &dims, const TensorFormat &format, std::vector<uint8_t> &storage)
+{
+  FILE *file = fopen(path, "rb");
+  if (!file)
+  {
+    fprintf(stderr, "Failed to open '%s'\n", path);
+    return false;
+  }
+
+  std::vector<float> data(dims.numElements);
+  size_t read = fread(data.data(), sizeof(float), data.size(), file);
+  bool trailing = fgetc(file) != EOF;
+  fclose(file);
+
+  if (read != data.size() || trailing)
+  {
+    fprintf(stderr, "'%s' does not hold %u x %u x %u floats\n", path, dims.d[0], dims.d[1], dims.d[2]);
+    return false;
+  }
+  convert_tensor(data, format, storage);
+  return true;
+}
+
+static inline double
+elapsed_us(bench_clock::time_point start)
+{
+  return std::chrono::duration<double, std::micro>(bench_clock::now() - start).count();
+}
+
+/* Prints min/median/p99 of 'samples' in microseconds, the caller ends the line */
+static void
+print_stats(const char *name, std::vector<double> &samples)
+{
+  std::sort(samples.begin(), samples.end());
+  size_t n = samples.size();
+  size_t p99 = std::min(n - 1, (size_t)std::ceil(0.99 * n) - 1);
+  printf("  %-16s %10.1f %10.1f %10.1f", name, samples[0], samples[n / 2], samples[p99]);
+}
+
+static void
+print_usage(const char *argv0)
+{
+  fprintf(stderr,
+          "Usage: %s [OPTION...] <cmap-file> <paf-file> [<cmap-file> <paf-file> ...]\n"
+          "       %s [OPTION...] --replay=FILE\n"
+          "  --cmap-dims=C,H,W        cmap tensor dimensions (default 18,56,56)\n"
+          "  --paf-dims=C,H,W         paf tensor dimensions (default 42,56,56)\n"
+          "  --iterations=N           passes over all frames per configuration (default 100)\n"
+          "  --threads=N[,N...]       post-process thread counts to compare, 0 is serial (default 0)\n"
+          "  --skeleton=NAME          'body' (default) or 'hand'\n"
+          "  --peak-detector=NAME     'window' (default), 'separable', 'compact' or 'pyramid'\n"
+          "  --solver=NAME            'munkres' (default), 'lapjv' or 'greedy'\n"
+          "  --prune-links            drop sub-threshold limb candidates before the assignment\n"
+          "  --paf-sampling=NAME      'nearest' (default) or 'bilinear'\n"
+          "  --paf-sample-spacing=PX  pixels between limb samples, 0 uses a fixed count (default 0)\n"
+          "  --full-scan-interval=N   incremental peak search with a full scan every N frames (default 0, off)\n"
+          "  --search-radius=N        cells searched around the previous peaks (default 3)\n"
+          "  --search-energy-change=F relative region energy change forcing a full scan (default 0.3)\n"
+          "  --element-type=NAME      'float' (default), 'half' or 'int8': tensor files are converted to it\n"
+          "  --int8-scale=F           value of one int8 step (default 1/127)\n"
+          "  --replay=FILE            read the frames from a tensor capture instead of tensor files\n",
+          argv0, argv0);
+}
+
+/* Times all stages of 'Skeleton' on the loaded frames */
+template <class Skeleton>
+static int
+run_benchmark(std::vector<BenchFrame> &frames, NvDsInferDims &cmap_dims, NvDsInferDims &paf_dims,
+              const TensorFormat &cmap_format, const TensorFormat &paf_format,
+              const PostProcessParams &params, int iterations, const std::vector<int> &thread_counts)
+{
+  if (cmap_dims.d[0] != Skeleton::NUM_PARTS || paf_dims.d[0] != 2 * Skeleton::NUM_LINKS ||
+      paf_dims.d[1] != cmap_dims.d[1] || paf_dims.d[2] != cmap_dims.d[2])
+  {
+    fprintf(stderr, "The '%s' skeleton needs cmap dims %d,H,W and paf dims %d,H,W\n",
+            Skeleton::NAME, Skeleton::NUM_PARTS, 2 * Skeleton::NUM_LINKS);
+    return -1;
+  }
+
+  /* Every stream keeps its own incremental search, as the sources of the app do */
+  int num_streams = 0;
+  for (BenchFrame &frame : frames)
+    num_streams = std::max(num_streams, frame.stream + 1);
+  PostProcessWorkspace workspace;
+  std::vector<PeakSearchState> search_states(num_streams);
+  workspace.reserve(Skeleton::NUM_PARTS, Skeleton::NUM_LINKS, cmap_dims.d[1], cmap_dims.d[2],
+                    params.max_num_parts, params.max_num_objects);
+
+  static const char *data_type_names[] = {"float", "half", "int8", "int32"};
+  const AssignmentSolver &solver = assignment_solver(params.solver);
+  size_t num_samples = frames.size() * iterations;
+  printf("%zu frame(s) x %d iteration(s), %s skeleton, cmap %ux%ux%u %s, peak detector '%s', solver '%s'%s\n",
+         frames.size(), iterations, Skeleton::NAME, cmap_dims.d[0], cmap_dims.d[1], cmap_dims.d[2],
+         data_type_names[cmap_format.data_type], peak_detector_names[params.peak_detector],
+         assignment_solver_names[params.solver], params.prune_links ? " (pruned)" : "");
+  if (params.full_scan_interval > 0)
+    printf("incremental peak search, full scan every %d frame(s), radius %d\n",
+           params.full_scan_interval, params.search_radius);
+  printf("\n");
+
+  /* Per-stage cost, always serial so the stages can be timed one by one */
+  std::vector<double> samples[NUM_STAGES];
+  for (int s = 0; s < NUM_STAGES; s++)
+    samples[s].reserve(num_samples);
+
+  long total_objects = 0;
+  for (int it = 0; it < iterations; it++)
+  {
+    for (BenchFrame &frame : frames)
+    {
+      bench_clock::time_point frame_start = bench_clock::now();
+      bench_clock::time_point start = frame_start;
+
+      detect_peaks(workspace, frame.cmap, cmap_dims, params, &search_states[frame.stream], cmap_format);
+      samples[STAGE_FIND_PEAKS].push_back(elapsed_us(start));
+
+      start = bench_clock::now();
+      refine_peaks(workspace, frame.cmap, cmap_dims, params.window_size, cmap_format);
+      samples[STAGE_REFINE_PEAKS].push_back(elapsed_us(start));
+
+      start = bench_clock::now();
+      paf_score_graph<Skeleton>(workspace, frame.paf, paf_dims, params.num_integral_samples,
+                                params.paf_sampling, params.paf_sample_spacing, paf_format);
+      samples[STAGE_PAF_SCORE_GRAPH].push_back(elapsed_us(start));
+
+      start = bench_clock::now();
+      assignment<Skeleton>(workspace, params.link_threshold, solver, params.prune_links);
+      samples[STAGE_ASSIGNMENT].push_back(elapsed_us(start));
+
+      start = bench_clock::now();
+      total_objects += connect_parts<Skeleton>(workspace);
+      samples[STAGE_CONNECT_PARTS].push_back(elapsed_us(start));
+
+      samples[STAGE_END_TO_END].push_back(elapsed_us(frame_start));
+    }
+  }
+
+  printf("Serial stages (us)         min     median        p99\n");
+  for (int s = 0; s < NUM_STAGES; s++)
+  {
+    print_stats(stage_names[s], samples[s]);
+    printf("\n");
+  }
+  printf("  %.2f persons per frame\n\n", (double)total_objects / num_samples);
+
+  /* End-to-end cost through 'run_post_process' for every requested thread count */
+  printf("End to end (us)            min     median        p99        fps\n");
+  for (int threads : thread_counts)
+  {
+    std::unique_ptr<TaskScheduler> scheduler(threads > 0 ? new TaskScheduler(threads) : NULL);
+    std::vector<double> &e2e = samples[STAGE_END_TO_END];
+    e2e.clear();
+    search_states.assign(num_streams, PeakSearchState());
+
+    bench_clock::time_point run_start = bench_clock::now();
+    for (int it = 0; it < iterations; it++)
+    {
+      for (BenchFrame &frame : frames)
+      {
+        bench_clock::time_point start = bench_clock::now();
+        run_post_process<Skeleton>(workspace, scheduler.get(), frame.cmap, cmap_dims,
+                                   frame.paf, paf_dims, params, &search_states[frame.stream], cmap_format,
+                                   paf_format);
+        e2e.push_back(elapsed_us(start));
+      }
+    }
+    double total_s = elapsed_us(run_start) * 1e-6;
+
+    char name[32];
+    snprintf(name, sizeof(name), "threads=%d", threads);
+    print_stats(name, e2e);
+    printf(" %10.1f\n", num_samples / total_s);
+  }
+
+  return 0;
+}
+
+int main(int argc, char *argv[])
+{
+  NvDsInferDims cmap_dims;
+  NvDsInferDims paf_dims;
+  PostProcessParams params;
+  int iterations = 100;
+  std::vector<int> thread_counts(1, 0);
+  const char *replay_path = NULL;
+  TensorFormat format;
+  format.int8_scale = 1.0f / 127.0f;
+  SkeletonType skeleton = SKELETON_BODY;
+  TensorCaptureReader replay;
+
+  parse_dims("18,56,56", cmap_dims);
+  parse_dims("42,56,56", paf_dims);
+
+  static struct option long_options[] = {
+      {"cmap-dims", required_argument, NULL, 'c'},
+      {"paf-dims", required_argument, NULL, 'p'},
+      {"iterations", required_argument, NULL, 'i'},
+      {"threads", required_argument, NULL, 't'},
+      {"skeleton", required_argument, NULL, 'k'},
+      {"peak-detector", required_argument, NULL, 'd'},
+      {"solver", required_argument, NULL, 's'},
+      {"prune-links", no_argument, NULL, 'l'},
+      {"paf-sampling", required_argument, NULL, 'm'},
+      {"paf-sample-spacing", required_argument, NULL, 'g'},
+      {"full-scan-interval", required_argument, NULL, 'f'},
+      {"search-radius", required_argument, NULL, 'a'},
+      {"search-energy-change", required_argument, NULL, 'e'},
+      {"element-type", required_argument, NULL, 'y'},
+      {"int8-scale", required_argument, NULL, 'q'},
+      {"replay", required_argument, NULL, 'r'},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0}};
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1)
+  {
+    bool ok = true;
+    switch (opt)
+    {
+    case 'c':
+      ok = parse_dims(optarg, cmap_dims);
+      break;
+    case 'p':
+      ok = parse_dims(optarg, paf_dims);
+      break;
+    case 'i':
+      iterations = atoi(optarg);
+      ok = iterations > 0;
+      break;
+    case 't':
+      ok = parse_int_list(optarg, thread_counts);
+      break;
+    case 'k':
+      ok = skeleton_from_string(optarg, skeleton);
+      break;
+    case 'd':
+      ok = peak_detector_from_string(optarg, params.peak_detector);
+      break;
+    case 's':
+      ok = assignment_solver_from_string(optarg, params.solver);
+      break;
+    case 'l':
+      params.prune_links = true;
+      break;
+    case 'm':
+      ok = paf_sampling_from_string(optarg, params.paf_sampling);
+      break;
+    case 'g':
+      params.paf_sample_spacing = atof(optarg);
+      ok = params.paf_sample_spacing >= 0.0f;
+      break;
+    case 'f':
+      params.full_scan_interval = atoi(optarg);
+      ok = params.full_scan_interval >= 0;
+      break;
+    case 'a':
+      params.search_radius = atoi(optarg);
+      ok = params.search_radius >= 0;
+      break;
+    case 'e':
+      params.search_energy_change = atof(optarg);
+      ok = params.search_energy_change >= 0.0f;
+      break;
+    case 'y':
+      ok = data_type_from_string(optarg, format.data_type);
+      break;
+    case 'q':
+      format.int8_scale = atof(optarg);
+      ok = format.int8_scale > 0.0f;
+      break;
+    case 'r':
+      replay_path = optarg;
+      break;
+    default:
+      ok = false;
+      break;
+    }
+    if (!ok)
+    {
+      print_usage(argv[0]);
+      return -1;
+    }
+  }
+
+  int num_files = argc - optind;
+  std::vector<BenchFrame> frames;
+  TensorFormat cmap_format = format;
+  TensorFormat paf_format = format;
+
+  if (replay_path)
+  {
+    if (num_files || !replay.open(replay_path) || !replay.numFrames())
+    {
+      fprintf(stderr, "Failed to replay '%s'\n", replay_path);
+      return -1;
+    }
+    if (replay.droppedRecords())
+      fprintf(stderr, "Skipping %d corrupt record(s) of '%s'\n", replay.droppedRecords(), replay_path);
+
+    /* Frames are used in place, the capture fixes the tensor dimensions */
+    std::map<uint32_t, int> streams;
+    frames.resize(replay.numFrames());
+    for (int f = 0; f < replay.numFrames(); f++)
+    {
+      TensorCaptureFrame capture;
+      replay.frame(f, capture);
+      if (!tensor_data_type_supported(capture.layers_info[0].dataType) ||
+          !tensor_data_type_supported(capture.layers_info[1].dataType))
+      {
+        fprintf(stderr, "Frame %d of '%s' has an unsupported element type\n", f, replay_path);
+        return -1;
+      }
+      if (f == 0)
+      {
+        cmap_dims = capture.layers_info[0].inferDims;
+        paf_dims = capture.layers_info[1].inferDims;
+        cmap_format.data_type = capture.layers_info[0].dataType;
+        paf_format.data_type = capture.layers_info[1].dataType;
+      }
+      else if (memcmp(cmap_dims.d, capture.layers_info[0].inferDims.d, sizeof(cmap_dims.d)) ||
+               memcmp(paf_dims.d, capture.layers_info[1].inferDims.d, sizeof(paf_dims.d)) ||
+               cmap_format.data_type != capture.layers_info[0].dataType ||
+               paf_format.data_type != capture.layers_info[1].dataType)
+      {
+        fprintf(stderr, "Frame %d of '%s' changes the tensor dimensions or element types\n", f, replay_path);
+        return -1;
+      }
+      frames[f].cmap = capture.host_buffers[0];
+      frames[f].paf = capture.host_buffers[1];
+      frames[f].stream = streams.emplace(capture.record->source_id, (int)streams.size()).first->second;
+    }
+  }
+  else
+  {
+    if (num_files < 2 || num_files % 2)
+    {
+      print_usage(argv[0]);
+      return -1;
+    }
+
+    frames.resize(num_files / 2);
+    for (size_t f = 0; f < frames.size(); f++)
+    {
+      if (!load_tensor(argv[optind + 2 * f], cmap_dims, cmap_format, frames[f].cmap_storage) ||
+          !load_tensor(argv[optind + 2 * f + 1], paf_dims, paf_format, frames[f].paf_storage))
+        return -1;
+      frames[f].cmap = frames[f].cmap_storage.data();
+      frames[f].paf = frames[f].paf_storage.data();
+      frames[f].stream = 0;
+    }
+  }
+
+  return skeleton == SKELETON_HAND
+             ? run_benchmark<HandSkeleton>(frames, cmap_dims, paf_dims, cmap_format, paf_format, params,
+                                           iterations, thread_counts)
+             : run_benchmark<BodySkeleton>(frames, cmap_dims, paf_dims, cmap_format, paf_format, params,
+                                           iterations, thread_counts);
+}
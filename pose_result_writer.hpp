@@ -0,0 +1,362 @@
+#pragma once
+
+#include "pose_meta.hpp"
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct PoseResultWriterParams
+{
+  gint64 max_file_bytes = 64 << 20; /* size at which the file is rotated, 0 never rotates */
+  int max_files = 8;                /* rotated files kept next to the current one */
+  int fsync_interval_ms = 1000;     /* longest time written lines stay unsynced */
+  int max_pending = 1024;           /* frames queued for the writer before new ones are dropped */
+};
+
+/**
+ * Streams the poses of every frame to a JSON Lines file, one object per frame:
+ *
+ *   {"source_id":0,"frame_number":42,"pts":1400000000,"skeleton":"body",
+ *    "poses":[{"track_id":3,"keypoints":[[x,y,score],null,...]}, ...]}
+ *
+ * Keypoints are normalized like in the PoseMeta, missing ones are null and
+ * "track_id" is -1 without tracking. Frames written with a latency carry it as
+ * "latency_ns" after "pts".
+ *
+ * write() only copies the frame's PoseMeta into a pooled block and appends it
+ * to a pending batch. A writer thread takes the whole batch at once, formats
+ * it with json-glib, writes it with as few syscalls as possible and fsyncs at
+ * most every 'fsync_interval_ms'. When the file would grow past
+ * 'max_file_bytes' it is rotated logrotate style: 'path' becomes 'path.1',
+ * 'path.1' becomes 'path.2' and so on up to 'max_files'. If the writer falls
+ * more than 'max_pending' frames behind, new frames are dropped and counted
+ * instead of stalling the pipeline.
+ */
+class PoseResultWriter
+{
+public:
+  PoseResultWriter()
+      : running(false), fd(-1), file_bytes(0), stopping(false), dropped(0), failed(false) {}
+
+  ~PoseResultWriter()
+  {
+    close();
+  }
+
+  /* Opens 'path' for appending and starts the writer thread */
+  bool open(const char *path, const PoseResultWriterParams &params)
+  {
+    this->path = path;
+    this->params = params;
+    if (!openFile())
+      return false;
+
+    this->stopping = false;
+    /* A backlog holds up to 'max_pending' copies, which then return to the pool together */
+    pose_meta_pool().reserveFree(params.max_pending);
+    this->pending.reserve(params.max_pending);
+    this->batch.reserve(params.max_pending);
+    this->thread = std::thread(&PoseResultWriter::writerLoop, this);
+    this->running = true;
+    return true;
+  }
+
+  inline bool isOpen() const
+  {
+    return this->running;
+  }
+
+  /**
+   * Queues the poses of one frame. A negative 'latency_ns' is left out of the
+   * line. Returns false when the frame was dropped because the writer is too far
+   * behind. Safe to call from several threads.
+   */
+  bool write(PoseMeta *meta, guint source_id, guint64 frame_number, guint64 pts, gint64 latency_ns = -1)
+  {
+    /* Copied outside the lock, the queue check and push below are one step */
+    Record record = {source_id, frame_number, pts, latency_ns, pose_meta_duplicate(meta)};
+    bool queued, wake;
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      queued = (int)this->pending.size() < this->params.max_pending;
+      wake = queued && this->pending.empty();
+      if (queued)
+        this->pending.push_back(record);
+      else
+        this->dropped++;
+    }
+    if (!queued)
+    {
+      pose_meta_pool().release(record.meta);
+      return false;
+    }
+    if (wake)
+      this->cond.notify_one();
+    return true;
+  }
+
+  /**
+   * Writes out the queued frames, syncs and closes the file
+   */
+  void close()
+  {
+    this->running = false;
+    if (this->thread.joinable())
+    {
+      {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+      }
+      this->cond.notify_one();
+      this->thread.join();
+    }
+    if (this->fd >= 0)
+    {
+      fsync(this->fd);
+      ::close(this->fd);
+      this->fd = -1;
+    }
+  }
+
+  /* Frames dropped because the queue was full */
+  long droppedFrames()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->dropped;
+  }
+
+  /* Set once a write, sync or rotation failed, later frames are discarded */
+  bool hasFailed()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->failed;
+  }
+
+private:
+  struct Record
+  {
+    guint source_id;
+    guint64 frame_number;
+    guint64 pts;
+    gint64 latency_ns;
+    PoseMeta *meta;
+  };
+
+  /* Lines are gathered up to this size before they are written */
+  static const size_t WRITE_CHUNK = 256 * 1024;
+
+  bool openFile()
+  {
+    this->fd = ::open(this->path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (this->fd < 0)
+      return false;
+
+    struct stat st;
+    this->file_bytes = fstat(this->fd, &st) == 0 ? st.st_size : 0;
+    return true;
+  }
+
+  void writerLoop()
+  {
+    typedef std::chrono::steady_clock clock;
+    JsonBuilder *builder = json_builder_new();
+    JsonGenerator *generator = json_generator_new();
+    std::string buffer;
+    buffer.reserve(WRITE_CHUNK);
+
+    clock::time_point last_sync = clock::now();
+    bool unsynced = false;
+    bool ok = true;
+    while (true)
+    {
+      bool stop;
+      {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->cond.wait_for(lock, std::chrono::milliseconds(this->params.fsync_interval_ms),
+                            [this] { return this->stopping || !this->pending.empty(); });
+        this->batch.swap(this->pending);
+        stop = this->stopping;
+      }
+
+      for (Record &record : this->batch)
+      {
+        if (ok)
+        {
+          size_t start = buffer.size();
+          appendLine(builder, generator, record, buffer);
+
+          /* The line that would overflow the file goes to the next one */
+          if (this->params.max_file_bytes > 0 && this->file_bytes > 0 &&
+              this->file_bytes + (gint64)buffer.size() > this->params.max_file_bytes)
+          {
+            ok = writeAll(buffer.data(), start) && rotate();
+            buffer.erase(0, start);
+            unsynced = false;
+          }
+          if (ok && buffer.size() >= WRITE_CHUNK)
+          {
+            ok = writeAll(buffer.data(), buffer.size());
+            buffer.clear();
+            unsynced = true;
+          }
+        }
+        pose_meta_pool().release(record.meta);
+      }
+      this->batch.clear();
+
+      if (ok && !buffer.empty())
+      {
+        ok = writeAll(buffer.data(), buffer.size());
+        buffer.clear();
+        unsynced = true;
+      }
+      if (ok && unsynced &&
+          clock::now() - last_sync >= std::chrono::milliseconds(this->params.fsync_interval_ms))
+      {
+        ok = fdatasync(this->fd) == 0;
+        last_sync = clock::now();
+        unsynced = false;
+      }
+      if (!ok)
+      {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->failed = true;
+      }
+      if (stop)
+        break;
+    }
+
+    g_object_unref(generator);
+    g_object_unref(builder);
+  }
+
+  /* Formats 'record' as one JSON line at the end of 'buffer' */
+  static void appendLine(JsonBuilder *builder, JsonGenerator *generator, const Record &record,
+                         std::string &buffer)
+  {
+    PoseMeta *meta = record.meta;
+    json_builder_reset(builder);
+    json_builder_begin_object(builder);
+    json_builder_set_member_name(builder, "source_id");
+    json_builder_add_int_value(builder, record.source_id);
+    json_builder_set_member_name(builder, "frame_number");
+    json_builder_add_int_value(builder, record.frame_number);
+    json_builder_set_member_name(builder, "pts");
+    json_builder_add_int_value(builder, record.pts);
+    if (record.latency_ns >= 0)
+    {
+      json_builder_set_member_name(builder, "latency_ns");
+      json_builder_add_int_value(builder, record.latency_ns);
+    }
+    json_builder_set_member_name(builder, "skeleton");
+    json_builder_add_string_value(builder, meta->skeleton);
+
+    json_builder_set_member_name(builder, "poses");
+    json_builder_begin_array(builder);
+    for (int n = 0; n < meta->num_poses; n++)
+    {
+      PoseKeypoint *keypoints = meta->keypoints(n);
+      json_builder_begin_object(builder);
+      json_builder_set_member_name(builder, "track_id");
+      json_builder_add_int_value(builder, *meta->track_id(n));
+      json_builder_set_member_name(builder, "keypoints");
+      json_builder_begin_array(builder);
+      for (int c = 0; c < meta->num_parts; c++)
+      {
+        if (keypoints[c].score < 0.0f)
+        {
+          json_builder_add_null_value(builder);
+          continue;
+        }
+        json_builder_begin_array(builder);
+        json_builder_add_double_value(builder, keypoints[c].x);
+        json_builder_add_double_value(builder, keypoints[c].y);
+        json_builder_add_double_value(builder, keypoints[c].score);
+        json_builder_end_array(builder);
+      }
+      json_builder_end_array(builder);
+      json_builder_end_object(builder);
+    }
+    json_builder_end_array(builder);
+    json_builder_end_object(builder);
+
+    JsonNode *root = json_builder_get_root(builder);
+    json_generator_set_root(generator, root);
+    gsize length = 0;
+    gchar *text = json_generator_to_data(generator, &length);
+    buffer.append(text, length);
+    buffer.push_back('\n');
+    g_free(text);
+    json_node_unref(root);
+  }
+
+  bool writeAll(const char *data, size_t size)
+  {
+    while (size > 0)
+    {
+      ssize_t written = ::write(this->fd, data, size);
+      if (written < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+      data += written;
+      size -= written;
+      this->file_bytes += written;
+    }
+    return true;
+  }
+
+  /* Syncs and closes the current file, shifts the numbered ones and starts a new file */
+  bool rotate()
+  {
+    bool ok = fsync(this->fd) == 0;
+    ::close(this->fd);
+    this->fd = -1;
+
+    if (this->params.max_files > 0)
+    {
+      for (int n = this->params.max_files - 1; n >= 1; n--)
+      {
+        std::string from = this->path + "." + std::to_string(n);
+        std::string to = this->path + "." + std::to_string(n + 1);
+        rename(from.c_str(), to.c_str());
+      }
+      ok = rename(this->path.c_str(), (this->path + ".1").c_str()) == 0 && ok;
+    }
+    else
+    {
+      unlink(this->path.c_str());
+    }
+    return openFile() && ok;
+  }
+
+  bool running; /* between open() and close(), which run before and after the pipeline */
+  std::string path;
+  PoseResultWriterParams params;
+  int fd;            /* only used by the writer thread once it runs */
+  gint64 file_bytes;
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::vector<Record> pending; /* filled by write(), guarded by 'mutex' */
+  std::vector<Record> batch;   /* swapped with 'pending' by the writer thread */
+  bool stopping;
+  long dropped;
+  bool failed;
+  std::thread thread;
+};
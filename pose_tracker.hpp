@@ -0,0 +1,220 @@
+#pragma once
+
+#include "pose_meta.hpp"
+#include "assignment_solver.hpp"
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+struct PoseTrackerParams
+{
+  float min_similarity = 0.3f; /* OKS a pose needs to continue a track */
+  float falloff = 0.1f;        /* OKS per-keypoint constant, relative to the person's size */
+  int max_missed = 15;         /* frames a track survives without a matching pose */
+  int max_tracks = 64;
+  AssignmentSolverType solver = ASSIGNMENT_SOLVER_MUNKRES;
+};
+
+/**
+ * Follows the people of one source across frames. Every frame's poses are
+ * matched to the live tracks by object keypoint similarity (OKS), the same
+ * assignment problem as the limbs: the solvers maximize the total similarity
+ * and matches at or below 'min_similarity' are dropped. Unmatched poses start
+ * new tracks, tracks unmatched for more than 'max_missed' frames end.
+ *
+ * Tracks remember the last position of every part, so a person whose parts are
+ * briefly occluded is still matched on the visible ones. Track ids are never
+ * reused. Storage is sized by the first frames and reused afterwards.
+ */
+class PoseTracker
+{
+public:
+  /* Live tracks, 'missed' tells how many frames ago each one was last seen */
+  struct Track
+  {
+    int id;
+    int hits;
+    int missed;
+    float area;   /* bounding box area of the last known keypoints, normalized */
+    float motion; /* mean keypoint displacement of the last match, normalized */
+  };
+
+  PoseTracker() : num_parts(0), max_count(0), next_id(0) {}
+
+  explicit PoseTracker(const PoseTrackerParams &params) : PoseTracker()
+  {
+    this->params = params;
+  }
+
+  /**
+   * Matches the poses of 'meta' to the tracks, writes their track ids into it
+   * and updates the tracks. Poses that could not get a track keep id -1.
+   */
+  void update(PoseMeta &meta)
+  {
+    if (meta.num_parts != this->num_parts)
+    {
+      this->num_parts = meta.num_parts;
+      this->tracks.clear();
+      this->track_keypoints.clear();
+    }
+    reserve(std::max(meta.num_poses, this->params.max_tracks));
+
+    int num_tracks = this->tracks.size();
+    int num_poses = meta.num_poses;
+    for (int n = 0; n < num_poses; n++)
+      *meta.track_id(n) = -1;
+
+    /* Track t is row t, pose n column n */
+    MatrixView<float> similarity(this->similarity_data.data(), this->max_count);
+    for (int t = 0; t < num_tracks; t++)
+    {
+      for (int n = 0; n < num_poses; n++)
+        similarity[t][n] = oks(t, meta.keypoints(n));
+    }
+    assignment_solver(this->params.solver)
+        .solve(similarity, num_tracks, num_poses, this->params.min_similarity, true,
+               this->scratch, this->matches);
+
+    for (int t = 0; t < num_tracks; t++)
+    {
+      int n = this->matches.colForRow(t);
+      if (n >= 0 && similarity[t][n] > this->params.min_similarity)
+      {
+        *meta.track_id(n) = this->tracks[t].id;
+        assign(t, meta.keypoints(n));
+        this->tracks[t].hits++;
+        this->tracks[t].missed = 0;
+      }
+      else
+      {
+        this->tracks[t].missed++;
+      }
+    }
+
+    /* Drop expired tracks, keeping the order of the others */
+    int kept = 0;
+    for (int t = 0; t < num_tracks; t++)
+    {
+      if (this->tracks[t].missed > this->params.max_missed)
+        continue;
+      if (kept != t)
+      {
+        this->tracks[kept] = this->tracks[t];
+        std::copy(keypoints(t), keypoints(t) + this->num_parts, keypoints(kept));
+      }
+      kept++;
+    }
+    this->tracks.resize(kept);
+
+    for (int n = 0; n < num_poses; n++)
+    {
+      if (*meta.track_id(n) >= 0 || (int)this->tracks.size() >= this->params.max_tracks)
+        continue;
+      Track track = {this->next_id++, 1, 0, 0.0f, 0.0f};
+      this->tracks.push_back(track);
+      int t = this->tracks.size() - 1;
+      std::fill(keypoints(t), keypoints(t) + this->num_parts, PoseKeypoint{0.0f, 0.0f, -1.0f});
+      assign(t, meta.keypoints(n));
+      *meta.track_id(n) = track.id;
+    }
+  }
+
+  inline int numTracks() const
+  {
+    return (int)this->tracks.size();
+  }
+
+  inline const Track &track(int t) const
+  {
+    return this->tracks[t];
+  }
+
+  /* Last known position of every part of track 't', negative score for parts never seen */
+  inline PoseKeypoint *keypoints(int t)
+  {
+    return &this->track_keypoints[t * this->num_parts];
+  }
+
+private:
+  /* Sizes the buffers for 'count' tracks or poses, only ever grows */
+  void reserve(int count)
+  {
+    if ((int)this->track_keypoints.size() < this->params.max_tracks * this->num_parts)
+      this->track_keypoints.resize(this->params.max_tracks * this->num_parts);
+    if (count <= this->max_count)
+      return;
+    this->max_count = count;
+    this->similarity_data.assign(count * count, 0.0f);
+    this->scratch.reserve(count);
+    this->matches.resize(count, count);
+    this->tracks.reserve(this->params.max_tracks);
+  }
+
+  /* Similarity of track 't' and a pose over the parts both have, 0 when they share none */
+  float oks(int t, const PoseKeypoint *pose)
+  {
+    const PoseKeypoint *known = keypoints(t);
+    /* The area is floored so tracks of one or two parts still match within a few pixels */
+    float scale = std::max(this->tracks[t].area, 1e-3f) * this->params.falloff *
+                  this->params.falloff * 2.0f;
+    float sum = 0.0f;
+    int shared = 0;
+    for (int c = 0; c < this->num_parts; c++)
+    {
+      if (known[c].score < 0.0f || pose[c].score < 0.0f)
+        continue;
+      float dx = known[c].x - pose[c].x;
+      float dy = known[c].y - pose[c].y;
+      sum += expf(-(dx * dx + dy * dy) / scale);
+      shared++;
+    }
+    return shared ? sum / shared : 0.0f;
+  }
+
+  /* Moves track 't' to the parts seen in 'pose' and refreshes its size and motion */
+  void assign(int t, const PoseKeypoint *pose)
+  {
+    PoseKeypoint *known = keypoints(t);
+    float motion = 0.0f;
+    int moved = 0;
+    for (int c = 0; c < this->num_parts; c++)
+    {
+      if (pose[c].score < 0.0f)
+        continue;
+      if (known[c].score >= 0.0f)
+      {
+        motion += sqrtf((known[c].x - pose[c].x) * (known[c].x - pose[c].x) +
+                        (known[c].y - pose[c].y) * (known[c].y - pose[c].y));
+        moved++;
+      }
+      known[c] = pose[c];
+    }
+
+    float x0 = 1.0f, y0 = 1.0f, x1 = 0.0f, y1 = 0.0f;
+    for (int c = 0; c < this->num_parts; c++)
+    {
+      if (known[c].score < 0.0f)
+        continue;
+      x0 = std::min(x0, known[c].x);
+      y0 = std::min(y0, known[c].y);
+      x1 = std::max(x1, known[c].x);
+      y1 = std::max(y1, known[c].y);
+    }
+    this->tracks[t].area = x1 > x0 && y1 > y0 ? (x1 - x0) * (y1 - y0) : 0.0f;
+    this->tracks[t].motion = moved ? motion / moved : 0.0f;
+  }
+
+  PoseTrackerParams params;
+  int num_parts;
+  int max_count;
+  int next_id;
+
+  std::vector<Track> tracks;
+  std::vector<PoseKeypoint> track_keypoints;
+
+  std::vector<float> similarity_data;
+  AssignmentScratch scratch;
+  PairGraph matches;
+};
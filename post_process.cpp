@@ -3,8 +3,17 @@
 
 #include "pair_graph.hpp"
 #include "cover_table.hpp"
-#include "munkres_algorithm.cpp"
-
+#include "post_process_workspace.hpp"
+#include "simd.hpp"
+#include "tensor_element.hpp"
+#include "task_scheduler.hpp"
+#include "assignment_solver.cpp"
+#include "skeleton.hpp"
+#include "pose_metrics.hpp"
+
+#ifdef POSE_POSTPROCESS_STANDALONE
+#include "nvdsinfer_standin.h"
+#else
 #include <gst/gst.h>
 #include <glib.h>
 #include <stdio.h>
@@ -13,12 +22,14 @@
 #include "gstnvdsinfer.h"
 #include "nvdsgstutils.h"
 #include "nvbufsurface.h"
+#endif
 
 #include <stdio.h>
 #include <vector>
 #include <array>
-#include <queue>
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 
 #define EPS 1e-6
 
@@ -31,373 +42,1132 @@ using Vec3D = std::vector<Vec2D<T>>;
 
 static const int M = 2;
 
-static Vec2D<int> topology{
-    {0, 1, 15, 13},
-    {2, 3, 13, 11},
-    {4, 5, 16, 14},
-    {6, 7, 14, 12},
-    {8, 9, 11, 12},
-    {10, 11, 5, 7},
-    {12, 13, 6, 8},
-    {14, 15, 7, 9},
-    {16, 17, 8, 10},
-    {18, 19, 1, 2},
-    {20, 21, 0, 1},
-    {22, 23, 0, 2},
-    {24, 25, 1, 3},
-    {26, 27, 2, 4},
-    {28, 29, 3, 5},
-    {30, 31, 4, 6},
-    {32, 33, 17, 0},
-    {34, 35, 17, 5},
-    {36, 37, 17, 6},
-    {38, 39, 17, 11},
-    {40, 41, 17, 12}};
+
+/* Peak detectors selectable at runtime, all of them produce identical peak lists */
+enum PeakDetector
+{
+  PEAK_DETECTOR_WINDOW = 0,
+  PEAK_DETECTOR_SEPARABLE,
+  PEAK_DETECTOR_COMPACT,
+  PEAK_DETECTOR_PYRAMID
+};
+
+/* Names of the peak detectors, in PeakDetector order */
+static const char *peak_detector_names[] = {"window", "separable", "compact", "pyramid"};
+
+/* How the PAF is read at the sample points of a limb */
+enum PafSampling
+{
+  PAF_SAMPLING_NEAREST = 0,
+  PAF_SAMPLING_BILINEAR
+};
+
+/* Tunables of the post-processing stages */
+struct PostProcessParams
+{
+  float threshold = 0.1;
+  int window_size = 5;
+  int max_num_parts = 20;
+  int num_integral_samples = 7;
+  float link_threshold = 0.1;
+  int max_num_objects = 100;
+  PeakDetector peak_detector = PEAK_DETECTOR_WINDOW;
+  AssignmentSolverType solver = ASSIGNMENT_SOLVER_MUNKRES;
+  bool prune_links = false;
+  PafSampling paf_sampling = PAF_SAMPLING_NEAREST;
+  float paf_sample_spacing = 0.0f; /* pixels between limb samples, 0 keeps 'num_integral_samples' */
+  int full_scan_interval = 0;      /* incremental peak search: frames per full scan, 0 disables it */
+  int search_radius = 3;           /* cells searched around the previous frame's peaks */
+  float search_energy_change = 0.3f; /* relative region energy change forcing a full scan */
+};
+
+/* Element type of an output tensor, taken from the dataType of its layer. INT8 tensors do not
+   carry their quantization, 'int8_scale' is the value of one step. */
+struct TensorFormat
+{
+  NvDsInferDataType data_type = FLOAT;
+  float int8_scale = 1.0f;
+};
+
+/* Whether the post-processing reads tensors of 'data_type' */
+bool tensor_data_type_supported(NvDsInferDataType data_type)
+{
+  return data_type == FLOAT || data_type == HALF || data_type == INT8;
+}
+
+/* Outcome of check_tensor_meta, usable as a bit index to report every kind of problem once */
+enum TensorCheck
+{
+  TENSOR_CHECK_OK = 0,
+  TENSOR_CHECK_LAYERS,
+  TENSOR_CHECK_SHAPE,
+  TENSOR_CHECK_DATA_TYPE
+};
+
+/* Checks that the first two outputs of 'tensor_meta' are the cmap and paf of 'Skeleton' in an
+   element type the kernels read, and takes their formats' data types from the layers. Otherwise
+   'message' describes the problem and the frame has to be skipped. */
+template <class Skeleton>
+TensorCheck
+check_tensor_meta(const NvDsInferTensorMeta *tensor_meta, TensorFormat &cmap_format,
+                  TensorFormat &paf_format, char *message, size_t message_size)
+{
+  if (tensor_meta->num_output_layers < 2)
+  {
+    snprintf(message, message_size, "Model has %u output layers, the post-processing needs a cmap and a paf",
+             tensor_meta->num_output_layers);
+    return TENSOR_CHECK_LAYERS;
+  }
+
+  const NvDsInferLayerInfo &cmap_layer = tensor_meta->output_layers_info[0];
+  const NvDsInferLayerInfo &paf_layer = tensor_meta->output_layers_info[1];
+  if (cmap_layer.inferDims.d[0] != Skeleton::NUM_PARTS || paf_layer.inferDims.d[0] != 2 * Skeleton::NUM_LINKS)
+  {
+    snprintf(message, message_size, "Model outputs %u cmap / %u paf channels, the '%s' skeleton needs %d / %d",
+             cmap_layer.inferDims.d[0], paf_layer.inferDims.d[0], Skeleton::NAME, Skeleton::NUM_PARTS,
+             2 * Skeleton::NUM_LINKS);
+    return TENSOR_CHECK_SHAPE;
+  }
+
+  /* FP16 and INT8 engines may output their tensors as is, the kernels convert on load */
+  cmap_format.data_type = cmap_layer.dataType;
+  paf_format.data_type = paf_layer.dataType;
+  if (!tensor_data_type_supported(cmap_format.data_type) || !tensor_data_type_supported(paf_format.data_type))
+  {
+    snprintf(message, message_size, "Model outputs of data type %d / %d, only FLOAT, HALF and INT8 are supported",
+             cmap_format.data_type, paf_format.data_type);
+    return TENSOR_CHECK_DATA_TYPE;
+  }
+  return TENSOR_CHECK_OK;
+}
+
+/* Whether two frames of a batch share a peak search state, which happens when one source
+   repeats in the batch. Their post-processing must then run in frame order. */
+template <class Frame>
+bool frames_share_search_state(const std::vector<Frame> &frames)
+{
+  for (size_t i = 1; i < frames.size(); i++)
+  {
+    for (size_t j = 0; j < i; j++)
+    {
+      if (frames[i].search_state == frames[j].search_state)
+        return true;
+    }
+  }
+  return false;
+}
+
+/* Calls 'fn' with a TensorPtr reading 'data' as the element type of 'format' */
+template <class Fn>
+static inline void
+with_tensor(void *data, const TensorFormat &format, Fn fn)
+{
+  switch (format.data_type)
+  {
+  case HALF:
+    fn(TensorPtr<Half>(data));
+    break;
+  case INT8:
+    fn(TensorPtr<int8_t>(data, format.int8_scale));
+    break;
+  default:
+    fn(TensorPtr<float>(data));
+    break;
+  }
+}
+
+bool peak_detector_from_string(const char *name, PeakDetector &detector)
+{
+  for (int i = 0; i < (int)(sizeof(peak_detector_names) / sizeof(peak_detector_names[0])); i++)
+  {
+    if (!strcmp(name, peak_detector_names[i]))
+    {
+      detector = (PeakDetector)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool paf_sampling_from_string(const char *name, PafSampling &sampling)
+{
+  if (!strcmp(name, "nearest"))
+    sampling = PAF_SAMPLING_NEAREST;
+  else if (!strcmp(name, "bilinear"))
+    sampling = PAF_SAMPLING_BILINEAR;
+  else
+    return false;
+  return true;
+}
 
 /* Method to find peaks in the output tensor. 'window_size' represents how many pixels we are considering at once to find a maximum value, or a ‘peak’. 
    Once we find a peak, we mark it using the ‘is_peak’ boolean in the inner loop and assign this maximum value to the center pixel of our window. 
    This is then repeated until we cover the entire frame. */
-void find_peaks(Vec1D<int> &counts_out, Vec3D<int> &peaks_out, void *cmap_data,
-                NvDsInferDims &cmap_dims, float threshold, int window_size, int max_count)
+template <class T>
+void find_peaks_channel(PostProcessWorkspace &workspace, int c, TensorPtr<T> cmap_data,
+                        NvDsInferDims &cmap_dims, float threshold, int window_size)
 {
   int w = window_size / 2;
   int width = cmap_dims.d[2];
   int height = cmap_dims.d[1];
+  int max_count = workspace.max_count;
 
-  counts_out.assign(cmap_dims.d[0], 0);
-  peaks_out.assign(cmap_dims.d[0], Vec2D<int>(max_count, Vec1D<int>(M,
-                                                                    0)));
+  int count = 0;
+  TensorPtr<T> cmap_data_c = cmap_data + c * width * height;
 
-  for (unsigned int c = 0; c < cmap_dims.d[0]; c++)
+  for (int i = 0; i < height && count < max_count; i++)
   {
-    int count = 0;
-    float *cmap_data_c = (float *)cmap_data + c * width * height;
-
-    for (int i = 0; i < height && count < max_count; i++)
+    for (int j = 0; j < width && count < max_count; j++)
     {
-      for (int j = 0; j < width && count < max_count; j++)
+      float value = cmap_data_c[i * width + j];
+
+      if (value < threshold)
+        continue;
+
+      int ii_min = i - w;
+      int jj_min = j - w;
+      int ii_max = i + w + 1;
+      int jj_max = j + w + 1;
+
+      if (ii_min < 0)
+        ii_min = 0;
+      if (ii_max > height)
+        ii_max = height;
+      if (jj_min < 0)
+        jj_min = 0;
+      if (jj_max > width)
+        jj_max = width;
+
+      bool is_peak = true;
+      for (int ii = ii_min; ii < ii_max; ii++)
       {
-        float value = cmap_data_c[i * width + j];
-
-        if (value < threshold)
-          continue;
-
-        int ii_min = i - w;
-        int jj_min = j - w;
-        int ii_max = i + w + 1;
-        int jj_max = j + w + 1;
-
-        if (ii_min < 0)
-          ii_min = 0;
-        if (ii_max > height)
-          ii_max = height;
-        if (jj_min < 0)
-          jj_min = 0;
-        if (jj_max > width)
-          jj_max = width;
-
-        bool is_peak = true;
-        for (int ii = ii_min; ii < ii_max; ii++)
+        for (int jj = jj_min; jj < jj_max; jj++)
         {
-          for (int jj = jj_min; jj < jj_max; jj++)
+          if (cmap_data_c[ii * width + jj] > value)
           {
-            if (cmap_data_c[ii * width + jj] > value)
-            {
-              is_peak = false;
-            }
+            is_peak = false;
           }
         }
+      }
 
-        if (is_peak)
-        {
-          peaks_out[c][count][0] = i;
-          peaks_out[c][count][1] = j;
-          count++;
-        }
+      if (is_peak)
+      {
+        int *peak = workspace.peak(c, count);
+        peak[0] = i;
+        peak[1] = j;
+        count++;
       }
     }
-
-    counts_out[c] = count;
   }
+
+  workspace.counts[c] = count;
 }
 
-/* Normalize the peaks found in 'find_peaks' and apply non-maximal suppression*/
-Vec3D<float>
-refine_peaks(Vec1D<int> &counts,
-             Vec3D<int> &peaks, void *cmap_data, NvDsInferDims &cmap_dims,
-             int window_size)
+void find_peaks(PostProcessWorkspace &workspace, void *cmap_data,
+                NvDsInferDims &cmap_dims, float threshold, int window_size,
+                const TensorFormat &cmap_format = TensorFormat())
+{
+  with_tensor(cmap_data, cmap_format, [&](auto cmap) {
+    for (unsigned int c = 0; c < cmap_dims.d[0]; c++)
+      find_peaks_channel(workspace, c, cmap, cmap_dims, threshold, window_size);
+  });
+}
+
+/* Same peaks as 'find_peaks', but the window maximum is computed once per pixel with a separable
+   row-max/column-max filter instead of re-scanning the full window around every candidate.
+   A pixel is a peak when it passes 'threshold' and is not smaller than its window maximum,
+   which is exactly the 'is_peak' test above. Peaks are emitted in the same row-major order,
+   so the 'max_count' truncation is unchanged. */
+template <class T>
+void find_peaks_separable_channel(PostProcessWorkspace &workspace, int c, TensorPtr<T> cmap_data,
+                                  NvDsInferDims &cmap_dims, float threshold, int window_size)
 {
   int w = window_size / 2;
   int width = cmap_dims.d[2];
   int height = cmap_dims.d[1];
+  int max_count = workspace.max_count;
+  float *row_max = workspace.peak_scratch.data() + c * width * height;
+  simd_float threshold_v = simd_set1(threshold);
 
-  Vec3D<float> refined_peaks(peaks.size(), Vec2D<float>(peaks[0].size(),
-                                                        Vec1D<float>(peaks[0][0].size(), 0)));
+  int count = 0;
+  TensorPtr<T> cmap_data_c = cmap_data + c * width * height;
 
-  for (unsigned int c = 0; c < cmap_dims.d[0]; c++)
+  /* Horizontal pass: maximum over [j - w, j + w] clamped to the row */
+  for (int i = 0; i < height; i++)
   {
-    int count = counts[c];
-    auto &refined_peaks_a_bc = refined_peaks[c];
-    auto &peaks_a_bc = peaks[c];
-    float *cmap_data_c = (float *)cmap_data + c * width * height;
+    TensorPtr<T> src = cmap_data_c + i * width;
+    float *dst = row_max + i * width;
+    int j = 0;
+    for (; j < width && j < w; j++)
+    {
+      float m = src[j];
+      for (int jj = 0; jj <= j + w && jj < width; jj++)
+        m = src[jj] > m ? src[jj] : m;
+      dst[j] = m;
+    }
+    for (; j + w + SIMD_WIDTH <= width; j += SIMD_WIDTH)
+    {
+      simd_float m = simd_load(src + j - w);
+      for (int d = 1; d <= 2 * w; d++)
+        m = simd_max(m, simd_load(src + j - w + d));
+      simd_store(dst + j, m);
+    }
+    for (; j < width; j++)
+    {
+      float m = src[j];
+      for (int jj = j - w < 0 ? 0 : j - w; jj <= j + w && jj < width; jj++)
+        m = src[jj] > m ? src[jj] : m;
+      dst[j] = m;
+    }
+  }
 
-    for (int p = 0; p < count; p++)
+  /* Vertical pass fused with the peak test */
+  for (int i = 0; i < height && count < max_count; i++)
+  {
+    int ii_min = i - w < 0 ? 0 : i - w;
+    int ii_max = i + w + 1 > height ? height : i + w + 1;
+    TensorPtr<T> src = cmap_data_c + i * width;
+    int j = 0;
+
+    for (; j + SIMD_WIDTH <= width && count < max_count; j += SIMD_WIDTH)
     {
-      auto &refined_peak = refined_peaks_a_bc[p];
-      auto &peak = peaks_a_bc[p];
+      simd_float value = simd_load(src + j);
+      int mask = simd_mask_ge(value, threshold_v);
+      if (!mask)
+        continue;
 
-      int i = peak[0];
-      int j = peak[1];
-      float weight_sum = 0.0f;
+      simd_float m = simd_load(row_max + ii_min * width + j);
+      for (int ii = ii_min + 1; ii < ii_max; ii++)
+        m = simd_max(m, simd_load(row_max + ii * width + j));
+      mask &= simd_mask_ge(value, m);
 
-      for (int ii = i - w; ii < i + w + 1; ii++)
+      while (mask && count < max_count)
       {
-        int ii_idx = ii;
+        int *peak = workspace.peak(c, count);
+        peak[0] = i;
+        peak[1] = j + simd_mask_first(mask);
+        count++;
+        mask &= mask - 1;
+      }
+    }
 
-        if (ii < 0)
-          ii_idx = -ii;
-        else if (ii >= height)
-          ii_idx = height - (ii - height) - 2;
+    for (; j < width && count < max_count; j++)
+    {
+      float value = src[j];
+      if (value < threshold)
+        continue;
 
-        for (int jj = j - w; jj < j + w + 1; jj++)
-        {
-          int jj_idx = jj;
+      float m = row_max[ii_min * width + j];
+      for (int ii = ii_min + 1; ii < ii_max; ii++)
+        m = row_max[ii * width + j] > m ? row_max[ii * width + j] : m;
 
-          if (jj < 0)
-            jj_idx = -jj;
-          else if (jj >= width)
-            jj_idx = width - (jj - width) - 2;
+      if (value >= m)
+      {
+        int *peak = workspace.peak(c, count);
+        peak[0] = i;
+        peak[1] = j;
+        count++;
+      }
+    }
+  }
+
+  workspace.counts[c] = count;
+}
+
+void find_peaks_separable(PostProcessWorkspace &workspace, void *cmap_data,
+                          NvDsInferDims &cmap_dims, float threshold, int window_size,
+                          const TensorFormat &cmap_format = TensorFormat())
+{
+  with_tensor(cmap_data, cmap_format, [&](auto cmap) {
+    for (unsigned int c = 0; c < cmap_dims.d[0]; c++)
+      find_peaks_separable_channel(workspace, c, cmap, cmap_dims, threshold, window_size);
+  });
+}
+
+/* Same peaks as 'find_peaks', in two passes. A vectorized sweep compares the whole channel
+   against 'threshold' and compress-stores the indices of the pixels that pass into a dense
+   candidate list; only those candidates are then tested against their window. The list is in
+   row-major order, so the 'max_count' truncation is unchanged, and a channel without people
+   costs one compare per vector. */
+template <class T>
+void find_peaks_compact_channel(PostProcessWorkspace &workspace, int c, TensorPtr<T> cmap_data,
+                                NvDsInferDims &cmap_dims, float threshold, int window_size)
+{
+  int w = window_size / 2;
+  int width = cmap_dims.d[2];
+  int height = cmap_dims.d[1];
+  int size = width * height;
+  int max_count = workspace.max_count;
+  int *candidates = workspace.peak_candidates(c);
+  simd_float threshold_v = simd_set1(threshold);
+
+  int count = 0;
+  TensorPtr<T> cmap_data_c = cmap_data + c * width * height;
+
+  /* Threshold pass over the channel as one flat array */
+  int num_candidates = 0;
+  int p = 0;
+  for (; p + SIMD_WIDTH <= size; p += SIMD_WIDTH)
+  {
+    int mask = simd_mask_ge(simd_load(cmap_data_c + p), threshold_v);
+    if (mask)
+      num_candidates += simd_compress_index(candidates + num_candidates, p, mask);
+  }
+  for (; p < size; p++)
+  {
+    if (cmap_data_c[p] >= threshold)
+      candidates[num_candidates++] = p;
+  }
+
+  /* Window test of the candidates only */
+  for (int n = 0; n < num_candidates && count < max_count; n++)
+  {
+    int i = candidates[n] / width;
+    int j = candidates[n] - i * width;
+    float value = cmap_data_c[candidates[n]];
+
+    int ii_min = i - w < 0 ? 0 : i - w;
+    int ii_max = i + w + 1 > height ? height : i + w + 1;
+    int jj_min = j - w < 0 ? 0 : j - w;
+    int jj_max = j + w + 1 > width ? width : j + w + 1;
 
-          float weight = cmap_data_c[ii_idx * width + jj_idx];
-          refined_peak[0] += weight * ii;
-          refined_peak[1] += weight * jj;
-          weight_sum += weight;
+    bool is_peak = true;
+    for (int ii = ii_min; ii < ii_max && is_peak; ii++)
+    {
+      TensorPtr<T> row = cmap_data_c + ii * width;
+      for (int jj = jj_min; jj < jj_max; jj++)
+      {
+        if (row[jj] > value)
+        {
+          is_peak = false;
+          break;
         }
       }
+    }
 
-      refined_peak[0] /= weight_sum;
-      refined_peak[1] /= weight_sum;
-      refined_peak[0] += 0.5;
-      refined_peak[1] += 0.5;
-      refined_peak[0] /= height;
-      refined_peak[1] /= width;
+    if (is_peak)
+    {
+      int *peak = workspace.peak(c, count);
+      peak[0] = i;
+      peak[1] = j;
+      count++;
     }
   }
 
-  return refined_peaks;
+  workspace.counts[c] = count;
 }
 
-/* Create a bipartite graph to assign detected body-parts to a unique person in the frame. This method also takes care of finding the line integral to assign scores
-   to these points */
-Vec3D<float>
-paf_score_graph(void *paf_data, NvDsInferDims &paf_dims,
-                Vec2D<int> &topology, Vec1D<int> &counts,
-                Vec3D<float> &peaks, int num_integral_samples)
+void find_peaks_compact(PostProcessWorkspace &workspace, void *cmap_data,
+                        NvDsInferDims &cmap_dims, float threshold, int window_size,
+                        const TensorFormat &cmap_format = TensorFormat())
 {
-  int K = topology.size();
-  int H = paf_dims.d[1];
-  int W = paf_dims.d[2];
-  int max_count = peaks[0].size();
-  Vec3D<float> score_graph(K, Vec2D<float>(max_count, Vec1D<float>(max_count, 0)));
+  with_tensor(cmap_data, cmap_format, [&](auto cmap) {
+    for (unsigned int c = 0; c < cmap_dims.d[0]; c++)
+      find_peaks_compact_channel(workspace, c, cmap, cmap_dims, threshold, window_size);
+  });
+}
 
-  for (int k = 0; k < K; k++)
+/* Same peaks as 'find_peaks', coarse to fine. The channel is max-pooled into 4x4 blocks with one
+   vectorized pass; the 2x2 blocks are only pooled inside the 4x4 blocks reaching 'threshold'.
+   Rows are then scanned in order, skipping every 4x4 and then 2x2 block whose maximum is below
+   'threshold', and only the pixels of the remaining blocks get the window test at full
+   resolution. No pixel of a skipped block can pass the threshold, so the peaks and their
+   row-major order are unchanged, while the cost past the pooling follows the area covered by
+   people. */
+template <class T>
+void find_peaks_pyramid_channel(PostProcessWorkspace &workspace, int c, TensorPtr<T> cmap_data,
+                                NvDsInferDims &cmap_dims, float threshold, int window_size)
+{
+  int w = window_size / 2;
+  int width = cmap_dims.d[2];
+  int height = cmap_dims.d[1];
+  int max_count = workspace.max_count;
+  int width1 = workspace.pyramid_width;
+  int height1 = workspace.pyramid_height;
+  int width2 = (width1 + 1) / 2;
+  int height2 = (height1 + 1) / 2;
+  float *level1 = workspace.pyramid_level(c, 1);
+  float *level2 = workspace.pyramid_level(c, 2);
+  int *blocks = workspace.peak_candidates(c);
+
+  int count = 0;
+  TensorPtr<T> cmap_data_c = cmap_data + c * width * height;
+
+  /* Level 2: maximum of each band of four rows, then of every four columns. Rows past the
+     bottom repeat the last one. */
+  for (int i2 = 0; i2 < height2; i2++)
   {
-    auto &score_graph_nk = score_graph[k];
-    auto &paf_i_idx = topology[k][0];
-    auto &paf_j_idx = topology[k][1];
-    auto &cmap_a_idx = topology[k][2];
-    auto &cmap_b_idx = topology[k][3];
-    float *paf_i = (float *)paf_data + paf_i_idx * H * W;
-    float *paf_j = (float *)paf_data + paf_j_idx * H * W;
-
-    auto &counts_a = counts[cmap_a_idx];
-    auto &counts_b = counts[cmap_b_idx];
-    auto &peaks_a = peaks[cmap_a_idx];
-    auto &peaks_b = peaks[cmap_b_idx];
-
-    for (int a = 0; a < counts_a; a++)
+    int i0 = 4 * i2;
+    TensorPtr<T> row0 = cmap_data_c + i0 * width;
+    TensorPtr<T> row1 = row0 + (std::min(i0 + 1, height - 1) - i0) * width;
+    TensorPtr<T> row2 = row0 + (std::min(i0 + 2, height - 1) - i0) * width;
+    TensorPtr<T> row3 = row0 + (std::min(i0 + 3, height - 1) - i0) * width;
+    float *dst = level2 + i2 * width2;
+    int j = 0;
+    for (; j + 4 * SIMD_WIDTH <= width; j += 4 * SIMD_WIDTH)
     {
-      // Point A
-      float pa_i = peaks_a[a][0] * H;
-      float pa_j = peaks_a[a][1] * W;
-
-      for (int b = 0; b < counts_b; b++)
+      simd_float m[4];
+      for (int v = 0; v < 4; v++)
       {
-        // Point B
-        float pb_i = peaks_b[b][0] * H;
-        float pb_j = peaks_b[b][1] * W;
-
-        // Vector from Point A to Point B
-        float pab_i = pb_i - pa_i;
-        float pab_j = pb_j - pa_j;
-
-        // Normalized Vector from Point A to Point B
-        float pab_norm = sqrtf(pab_i * pab_i + pab_j * pab_j) + EPS;
-        float uab_i = pab_i / pab_norm;
-        float uab_j = pab_j / pab_norm;
+        int jv = j + v * SIMD_WIDTH;
+        m[v] = simd_max(simd_max(simd_load(row0 + jv), simd_load(row1 + jv)),
+                        simd_max(simd_load(row2 + jv), simd_load(row3 + jv)));
+      }
+      simd_store(dst + j / 4, simd_pair_max(simd_pair_max(m[0], m[1]), simd_pair_max(m[2], m[3])));
+    }
+    for (; j < width; j += 4)
+    {
+      float m = row0[j];
+      for (int jj = j; jj < j + 4 && jj < width; jj++)
+        m = std::max(m, std::max(std::max(row0[jj], row1[jj]), std::max(row2[jj], row3[jj])));
+      dst[j / 4] = m;
+    }
+  }
 
-        float integral = 0.0;
-        float increment = 1.0f / num_integral_samples;
+  for (int i2 = 0; i2 < height2 && count < max_count; i2++)
+  {
+    /* 4x4 blocks of this band that may hold a peak, shared by its four rows */
+    int num_blocks = 0;
+    for (int j2 = 0; j2 < width2; j2++)
+    {
+      blocks[num_blocks] = j2;
+      num_blocks += level2[i2 * width2 + j2] >= threshold;
+    }
 
-        for (int t = 0; t < num_integral_samples; t++)
+    /* Level 1 within those blocks */
+    for (int b = 0; b < num_blocks; b++)
+    {
+      for (int i1 = 2 * i2; i1 < 2 * i2 + 2 && i1 < height1; i1++)
+      {
+        for (int j1 = 2 * blocks[b]; j1 < 2 * blocks[b] + 2 && j1 < width1; j1++)
         {
-          // Integral Point T
-          float progress = (float)t / (float)num_integral_samples;
-          float pt_i = pa_i + progress * pab_i;
-          float pt_j = pa_j + progress * pab_j;
+          float m = cmap_data_c[2 * i1 * width + 2 * j1];
+          for (int i = 2 * i1; i < 2 * i1 + 2 && i < height; i++)
+            for (int j = 2 * j1; j < 2 * j1 + 2 && j < width; j++)
+              m = std::max(m, cmap_data_c[i * width + j]);
+          level1[i1 * width1 + j1] = m;
+        }
+      }
+    }
 
-          // Convert to Integer
-          int pt_i_int = (int)pt_i;
-          int pt_j_int = (int)pt_j;
+    for (int i = 4 * i2; i < 4 * i2 + 4 && i < height && count < max_count; i++)
+    {
+      const float *pooled = level1 + (i / 2) * width1;
+      TensorPtr<T> row_i = cmap_data_c + i * width;
+      int ii_min = i - w < 0 ? 0 : i - w;
+      int ii_max = i + w + 1 > height ? height : i + w + 1;
 
-          // Edge cases for if the point is out of bounds, just skip them
-          if (pt_i_int < 0)
-            continue;
-          if (pt_i_int > H)
-            continue;
-          if (pt_j_int < 0)
-            continue;
-          if (pt_j_int > W)
+      for (int b = 0; b < num_blocks && count < max_count; b++)
+      {
+        for (int j1 = 2 * blocks[b]; j1 < 2 * blocks[b] + 2 && j1 < width1; j1++)
+        {
+          if (pooled[j1] < threshold)
             continue;
 
-          // Vector at integral point
-          float pt_paf_i = paf_i[pt_i_int * W + pt_j_int];
-          float pt_paf_j = paf_j[pt_i_int * W + pt_j_int];
+          for (int j = 2 * j1; j < 2 * j1 + 2 && j < width && count < max_count; j++)
+          {
+            float value = row_i[j];
+            if (value < threshold)
+              continue;
 
-          // Dot Product Normalized A->B with PAF Vector
-          float dot = pt_paf_i * uab_i + pt_paf_j * uab_j;
-          integral += dot;
+            int jj_min = j - w < 0 ? 0 : j - w;
+            int jj_max = j + w + 1 > width ? width : j + w + 1;
 
-          progress += increment;
-        }
+            bool is_peak = true;
+            for (int ii = ii_min; ii < ii_max && is_peak; ii++)
+            {
+              TensorPtr<T> row = cmap_data_c + ii * width;
+              for (int jj = jj_min; jj < jj_max; jj++)
+              {
+                if (row[jj] > value)
+                {
+                  is_peak = false;
+                  break;
+                }
+              }
+            }
 
-        // Normalize the integral with respect to the number of samples
-        integral /= num_integral_samples;
-        score_graph_nk[a][b] = integral;
+            if (is_peak)
+            {
+              int *peak = workspace.peak(c, count);
+              peak[0] = i;
+              peak[1] = j;
+              count++;
+            }
+          }
+        }
       }
     }
   }
-  return score_graph;
+
+  workspace.counts[c] = count;
 }
 
-/*
- This method takes care of solving the graph assignment problem using Munkres algorithm. Munkres algorithm is defind in 'munkres_algorithm.cpp'
- */
+void find_peaks_pyramid(PostProcessWorkspace &workspace, void *cmap_data,
+                        NvDsInferDims &cmap_dims, float threshold, int window_size,
+                        const TensorFormat &cmap_format = TensorFormat())
+{
+  with_tensor(cmap_data, cmap_format, [&](auto cmap) {
+    for (unsigned int c = 0; c < cmap_dims.d[0]; c++)
+      find_peaks_pyramid_channel(workspace, c, cmap, cmap_dims, threshold, window_size);
+  });
+}
 
-Vec3D<int>
-assignment(Vec3D<float> &score_graph,
-           Vec2D<int> &topology, Vec1D<int> &counts, float score_threshold, int max_count)
+/* Calls 'fn(i, j0, j1)' for every row 'i' of the regions within 'radius' cells of the peaks of
+   channel 'c' in 'state', with the merged column interval [j0, j1) of each run of covered
+   cells, in row-major order */
+template <class Fn>
+static void
+for_each_region_span(PeakSearchState &state, int c, int radius, Fn fn)
 {
-  int K = topology.size();
-  Vec3D<int> connections(K, Vec2D<int>(M, Vec1D<int>(max_count, -1)));
+  int count = state.counts[c];
+  int height = state.height;
+  int width = state.width;
+  int *spans = state.regionSpans(c);
+  if (!count)
+    return;
+
+  int i_min = height;
+  int i_max = -1;
+  for (int p = 0; p < count; p++)
+  {
+    i_min = std::min(i_min, state.peak(c, p)[0] - radius);
+    i_max = std::max(i_max, state.peak(c, p)[0] + radius);
+  }
+  i_min = std::max(i_min, 0);
+  i_max = std::min(i_max, height - 1);
 
-  Vec3D<float> cost_graph = score_graph;
-  for (Vec2D<float> &cg_iter1 : cost_graph)
-    for (Vec1D<float> &cg_iter2 : cg_iter1)
-      for (float &cg_iter3 : cg_iter2)
-        cg_iter3 = -cg_iter3;
-  auto &cost_graph_out_a = cost_graph;
+  for (int i = i_min; i <= i_max; i++)
+  {
+    /* Intervals of the regions covering this row, sorted by start */
+    int num_spans = 0;
+    for (int p = 0; p < count; p++)
+    {
+      int *peak = state.peak(c, p);
+      if (abs(peak[0] - i) > radius)
+        continue;
+      int j0 = std::max(peak[1] - radius, 0);
+      int j1 = std::min(peak[1] + radius + 1, width);
+      int n = num_spans++;
+      for (; n > 0 && spans[(n - 1) * 2] > j0; n--)
+      {
+        spans[n * 2] = spans[(n - 1) * 2];
+        spans[n * 2 + 1] = spans[(n - 1) * 2 + 1];
+      }
+      spans[n * 2] = j0;
+      spans[n * 2 + 1] = j1;
+    }
 
-  for (int k = 0; k < K; k++)
+    for (int n = 0; n < num_spans;)
+    {
+      int j0 = spans[n * 2];
+      int j1 = spans[n * 2 + 1];
+      for (n++; n < num_spans && spans[n * 2] <= j1; n++)
+        j1 = std::max(j1, spans[n * 2 + 1]);
+      fn(i, j0, j1);
+    }
+  }
+}
+
+/* Window peak search restricted to the regions around the previous frame's peaks of channel 'c'.
+   Cells are tested in row-major order like a full scan, so it finds the same peaks as long as
+   none of them lies outside the regions. Returns the cmap energy of the regions. */
+template <class T>
+float find_peaks_region_channel(PostProcessWorkspace &workspace, int c, TensorPtr<T> cmap_data,
+                                NvDsInferDims &cmap_dims, float threshold, int window_size,
+                                PeakSearchState &state, int radius)
+{
+  int w = window_size / 2;
+  int width = cmap_dims.d[2];
+  int height = cmap_dims.d[1];
+  int max_count = workspace.max_count;
+  int *candidates = workspace.peak_candidates(c);
+  TensorPtr<T> cmap_data_c = cmap_data + c * width * height;
+
+  /* Branch-free threshold pass over the regions, like the compact detector's */
+  int num_candidates = 0;
+  float energy = 0.0f;
+  for_each_region_span(state, c, radius, [&](int i, int j0, int j1) {
+    TensorPtr<T> row_i = cmap_data_c + i * width;
+    for (int j = j0; j < j1; j++)
+    {
+      energy += row_i[j];
+      candidates[num_candidates] = i * width + j;
+      num_candidates += row_i[j] >= threshold;
+    }
+  });
+
+  int count = 0;
+  for (int n = 0; n < num_candidates && count < max_count; n++)
   {
-    int cmap_a_idx = topology[k][2];
-    int cmap_b_idx = topology[k][3];
-    int nrows = counts[cmap_a_idx];
-    int ncols = counts[cmap_b_idx];
-    auto star_graph = PairGraph(nrows, ncols);
-    auto &cost_graph_out_a_nk = cost_graph_out_a[k];
-    munkres_algorithm(cost_graph_out_a_nk, star_graph, nrows, ncols);
-
-    auto &connections_a_nk = connections[k];
-    auto &score_graph_a_nk = score_graph[k];
-
-    for (int i = 0; i < nrows; i++)
+    int i = candidates[n] / width;
+    int j = candidates[n] - i * width;
+    TensorPtr<T> row_i = cmap_data_c + i * width;
+    float value = row_i[j];
+
+    /* Most region cells lie on the slope of a peak, so a larger direct neighbour is likely */
+    if (w > 0 && ((j > 0 && row_i[j - 1] > value) || (j + 1 < width && row_i[j + 1] > value) ||
+                  (i > 0 && row_i[j - width] > value) || (i + 1 < height && row_i[j + width] > value)))
+      continue;
+
+    int ii_min = i - w < 0 ? 0 : i - w;
+    int ii_max = i + w + 1 > height ? height : i + w + 1;
+    int jj_min = j - w < 0 ? 0 : j - w;
+    int jj_max = j + w + 1 > width ? width : j + w + 1;
+
+    bool is_peak = true;
+    for (int ii = ii_min; ii < ii_max && is_peak; ii++)
     {
-      for (int j = 0; j < ncols; j++)
+      TensorPtr<T> row = cmap_data_c + ii * width;
+      for (int jj = jj_min; jj < jj_max; jj++)
       {
-        if (star_graph.isPair(i, j) && score_graph_a_nk[i][j] > score_threshold)
+        if (row[jj] > value)
         {
-          connections_a_nk[0][i] = j;
-          connections_a_nk[1][j] = i;
+          is_peak = false;
+          break;
         }
       }
     }
+
+    if (is_peak)
+    {
+      int *peak = workspace.peak(c, count);
+      peak[0] = i;
+      peak[1] = j;
+      count++;
+    }
   }
-  return connections;
+
+  workspace.counts[c] = count;
+  return energy;
 }
 
-/* This method takes care of connecting all the body parts detected to each other 
-   after finding the relationships between them in the 'assignment' method */
-Vec2D<int>
-connect_parts(
-    Vec3D<int> &connections, Vec2D<int> &topology, Vec1D<int> &counts,
-    int max_count)
+/* Stores the peaks of channel 'c' as the next frame's search regions. 'energy' is the cmap sum
+   over the regions the frame was searched in, a full scan measures it on the new regions. */
+template <class T>
+static void
+remember_peaks_channel(PostProcessWorkspace &workspace, int c, TensorPtr<T> cmap_data,
+                       PeakSearchState &state, int radius, const float *energy)
+{
+  int count = workspace.counts[c];
+  TensorPtr<T> cmap_data_c = cmap_data + c * state.width * state.height;
+
+  state.counts[c] = count;
+  std::copy(workspace.peak(c, 0), workspace.peak(c, 0) + count * 2, state.peak(c, 0));
+  if (energy)
+  {
+    state.energies[c] = *energy;
+    return;
+  }
+
+  float sum = 0.0f;
+  for_each_region_span(state, c, radius, [&](int i, int j0, int j1) {
+    for (int j = j0; j < j1; j++)
+      sum += cmap_data_c[i * state.width + j];
+  });
+  state.energies[c] = sum;
+}
+
+/* Peak detection of one channel with the detector chosen in 'params'. With 'search_state'
+   and outside full-scan frames, only the regions around the previous peaks are searched,
+   unless their energy changed by more than 'search_energy_change'. */
+template <class T>
+void detect_peaks_channel(PostProcessWorkspace &workspace, int c, TensorPtr<T> cmap_data,
+                          NvDsInferDims &cmap_dims, const PostProcessParams &params,
+                          PeakSearchState *search_state = nullptr)
+{
+  if (search_state && !search_state->full_scan)
+  {
+    float previous = search_state->energies[c];
+    float energy = find_peaks_region_channel(workspace, c, cmap_data, cmap_dims, params.threshold,
+                                             params.window_size, *search_state, params.search_radius);
+    if (fabsf(energy - previous) <= params.search_energy_change * previous)
+    {
+      remember_peaks_channel(workspace, c, cmap_data, *search_state, params.search_radius, &energy);
+      return;
+    }
+  }
+
+  switch (params.peak_detector)
+  {
+  case PEAK_DETECTOR_SEPARABLE:
+    find_peaks_separable_channel(workspace, c, cmap_data, cmap_dims, params.threshold, params.window_size);
+    break;
+  case PEAK_DETECTOR_COMPACT:
+    find_peaks_compact_channel(workspace, c, cmap_data, cmap_dims, params.threshold, params.window_size);
+    break;
+  case PEAK_DETECTOR_PYRAMID:
+    find_peaks_pyramid_channel(workspace, c, cmap_data, cmap_dims, params.threshold, params.window_size);
+    break;
+  default:
+    find_peaks_channel(workspace, c, cmap_data, cmap_dims, params.threshold, params.window_size);
+    break;
+  }
+
+  if (search_state)
+    remember_peaks_channel(workspace, c, cmap_data, *search_state, params.search_radius, nullptr);
+}
+
+/* Peak detection of every channel. Starts a frame of 'search_state' when one is given, the
+   incremental search is then used whenever 'full_scan_interval' is set. */
+void detect_peaks(PostProcessWorkspace &workspace, void *cmap_data, NvDsInferDims &cmap_dims,
+                  const PostProcessParams &params, PeakSearchState *search_state = nullptr,
+                  const TensorFormat &cmap_format = TensorFormat())
+{
+  if (params.full_scan_interval <= 0)
+    search_state = nullptr;
+  if (search_state)
+    search_state->beginFrame(cmap_dims.d[0], cmap_dims.d[1], cmap_dims.d[2], workspace.max_count,
+                             params.full_scan_interval);
+
+  with_tensor(cmap_data, cmap_format, [&](auto cmap) {
+    for (unsigned int c = 0; c < cmap_dims.d[0]; c++)
+      detect_peaks_channel(workspace, c, cmap, cmap_dims, params, search_state);
+  });
+}
+
+/* Normalize the peaks found in 'find_peaks' and apply non-maximal suppression. Also records
+   the confidence of every peak. */
+template <class T>
+void refine_peaks_channel(PostProcessWorkspace &workspace, int c, TensorPtr<T> cmap_data,
+                          NvDsInferDims &cmap_dims, int window_size)
+{
+  int w = window_size / 2;
+  int width = cmap_dims.d[2];
+  int height = cmap_dims.d[1];
+
+  int count = workspace.counts[c];
+  TensorPtr<T> cmap_data_c = cmap_data + c * width * height;
+
+  for (int p = 0; p < count; p++)
+  {
+    float *refined_peak = workspace.refined_peak(c, p);
+    int *peak = workspace.peak(c, p);
+
+    int i = peak[0];
+    int j = peak[1];
+    workspace.peak_score(c, p) = cmap_data_c[i * width + j];
+    float refined_i = 0.0f;
+    float refined_j = 0.0f;
+    float weight_sum = 0.0f;
+
+    for (int ii = i - w; ii < i + w + 1; ii++)
+    {
+      int ii_idx = ii;
+
+      if (ii < 0)
+        ii_idx = -ii;
+      else if (ii >= height)
+        ii_idx = height - (ii - height) - 2;
+
+      for (int jj = j - w; jj < j + w + 1; jj++)
+      {
+        int jj_idx = jj;
+
+        if (jj < 0)
+          jj_idx = -jj;
+        else if (jj >= width)
+          jj_idx = width - (jj - width) - 2;
+
+        float weight = cmap_data_c[ii_idx * width + jj_idx];
+        refined_i += weight * ii;
+        refined_j += weight * jj;
+        weight_sum += weight;
+      }
+    }
+
+    refined_i /= weight_sum;
+    refined_j /= weight_sum;
+    refined_i += 0.5;
+    refined_j += 0.5;
+    refined_peak[0] = refined_i / height;
+    refined_peak[1] = refined_j / width;
+  }
+}
+
+void refine_peaks(PostProcessWorkspace &workspace, void *cmap_data,
+                  NvDsInferDims &cmap_dims, int window_size,
+                  const TensorFormat &cmap_format = TensorFormat())
+{
+  with_tensor(cmap_data, cmap_format, [&](auto cmap) {
+    for (unsigned int c = 0; c < cmap_dims.d[0]; c++)
+      refine_peaks_channel(workspace, c, cmap, cmap_dims, window_size);
+  });
+}
+
+/* Gathers the PAF vector of every lane at pixel coordinates (pt_i, pt_j). Nearest sampling
+   truncates like the original scalar code and leaves samples outside the map out of the
+   integral, bilinear sampling clamps to the pixel centers of the border. */
+template <class T>
+static inline void
+sample_paf(TensorPtr<T> paf_i, TensorPtr<T> paf_j, int H, int W, PafSampling sampling,
+           simd_float pt_i, simd_float pt_j, simd_mask &valid, simd_float &v_i, simd_float &v_j)
+{
+  const simd_float zero = simd_set1(0.0f);
+  const simd_float width = simd_set1((float)W);
+
+  if (sampling == PAF_SAMPLING_NEAREST)
+  {
+    simd_float ti = simd_trunc(pt_i);
+    simd_float tj = simd_trunc(pt_j);
+    valid = simd_mask_and(valid, simd_mask_and(simd_cmp_ge(ti, zero), simd_cmp_lt(ti, simd_set1((float)H))));
+    valid = simd_mask_and(valid, simd_mask_and(simd_cmp_ge(tj, zero), simd_cmp_lt(tj, width)));
+
+    /* Out of bounds lanes read element 0 and are masked out of the sum */
+    simd_float index = simd_masked(simd_add(simd_mul(ti, width), tj), valid);
+    v_i = simd_gather(paf_i, index);
+    v_j = simd_gather(paf_j, index);
+    return;
+  }
+
+  /* Pixel centers sit at +0.5, see 'refine_peaks_channel' */
+  const simd_float half = simd_set1(0.5f);
+  const simd_float one = simd_set1(1.0f);
+  const simd_float max_i = simd_set1((float)(H - 1));
+  const simd_float max_j = simd_set1((float)(W - 1));
+  simd_float yi = simd_min(simd_max(simd_sub(pt_i, half), zero), max_i);
+  simd_float xj = simd_min(simd_max(simd_sub(pt_j, half), zero), max_j);
+  simd_float i0 = simd_trunc(yi);
+  simd_float j0 = simd_trunc(xj);
+  simd_float di = simd_sub(yi, i0);
+  simd_float dj = simd_sub(xj, j0);
+
+  simd_float row0 = simd_mul(i0, width);
+  simd_float row1 = simd_mul(simd_min(simd_add(i0, one), max_i), width);
+  simd_float j1 = simd_min(simd_add(j0, one), max_j);
+  simd_float index00 = simd_add(row0, j0);
+  simd_float index01 = simd_add(row0, j1);
+  simd_float index10 = simd_add(row1, j0);
+  simd_float index11 = simd_add(row1, j1);
+
+  simd_float w00 = simd_mul(simd_sub(one, di), simd_sub(one, dj));
+  simd_float w01 = simd_mul(simd_sub(one, di), dj);
+  simd_float w10 = simd_mul(di, simd_sub(one, dj));
+  simd_float w11 = simd_mul(di, dj);
+
+  v_i = simd_add(simd_add(simd_mul(w00, simd_gather(paf_i, index00)), simd_mul(w01, simd_gather(paf_i, index01))),
+                 simd_add(simd_mul(w10, simd_gather(paf_i, index10)), simd_mul(w11, simd_gather(paf_i, index11))));
+  v_j = simd_add(simd_add(simd_mul(w00, simd_gather(paf_j, index00)), simd_mul(w01, simd_gather(paf_j, index01))),
+                 simd_add(simd_mul(w10, simd_gather(paf_j, index10)), simd_mul(w11, simd_gather(paf_j, index11))));
+}
+
+/* Create a bipartite graph to assign detected body-parts to a unique person in the frame. This method also takes care of finding the line integral to assign scores
+   to these points. All (a, b) candidate pairs of the link are laid out flat and scored SIMD_WIDTH at a time. With a
+   'sample_spacing' in pixels, every limb is sampled about that often, between 2 and 'num_integral_samples' times. */
+template <class Skeleton, class T>
+void paf_score_link(PostProcessWorkspace &workspace, int k, TensorPtr<T> paf_data,
+                    NvDsInferDims &paf_dims, int num_integral_samples,
+                    PafSampling sampling, float sample_spacing)
+{
+  int H = paf_dims.d[1];
+  int W = paf_dims.d[2];
+
+  MatrixView<float> score_graph_nk = workspace.score_graph(k);
+  const SkeletonLink &link = Skeleton::links[k];
+  int paf_i_idx = link.paf_i;
+  int paf_j_idx = link.paf_j;
+  int cmap_a_idx = link.part_a;
+  int cmap_b_idx = link.part_b;
+  TensorPtr<T> paf_i = paf_data + paf_i_idx * H * W;
+  TensorPtr<T> paf_j = paf_data + paf_j_idx * H * W;
+
+  int counts_a = workspace.counts[cmap_a_idx];
+  int counts_b = workspace.counts[cmap_b_idx];
+  int num_pairs = counts_a * counts_b;
+  if (!num_pairs)
+    return;
+
+  /* Points A and B of every pair in pixels, the padding lanes repeat the last pair */
+  int padded_pairs = (num_pairs + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+  LinkPairs pairs = workspace.link_pairs(k);
+  for (int p = 0; p < padded_pairs; p++)
+  {
+    int pair = std::min(p, num_pairs - 1);
+    float *peak_a = workspace.refined_peak(cmap_a_idx, pair / counts_b);
+    float *peak_b = workspace.refined_peak(cmap_b_idx, pair % counts_b);
+    pairs.pa_i[p] = peak_a[0] * H;
+    pairs.pa_j[p] = peak_a[1] * W;
+    pairs.pb_i[p] = peak_b[0] * H;
+    pairs.pb_j[p] = peak_b[1] * W;
+  }
+
+  const simd_float eps = simd_set1((float)EPS);
+  const simd_float min_samples = simd_set1(2.0f);
+  const simd_float max_samples = simd_set1((float)num_integral_samples);
+  const simd_float spacing = simd_set1(sample_spacing);
+  float lanes[SIMD_WIDTH];
+
+  for (int p = 0; p < padded_pairs; p += SIMD_WIDTH)
+  {
+    // Point A
+    simd_float pa_i = simd_load(pairs.pa_i + p);
+    simd_float pa_j = simd_load(pairs.pa_j + p);
+
+    // Vector from Point A to Point B
+    simd_float pab_i = simd_sub(simd_load(pairs.pb_i + p), pa_i);
+    simd_float pab_j = simd_sub(simd_load(pairs.pb_j + p), pa_j);
+
+    // Normalized Vector from Point A to Point B
+    simd_float pab_norm = simd_add(simd_sqrt(simd_add(simd_mul(pab_i, pab_i), simd_mul(pab_j, pab_j))), eps);
+    simd_float uab_i = simd_div(pab_i, pab_norm);
+    simd_float uab_j = simd_div(pab_j, pab_norm);
+
+    // Number of samples along each limb
+    simd_float samples = max_samples;
+    int max_t = num_integral_samples;
+    if (sample_spacing > 0.0f)
+    {
+      samples = simd_trunc(simd_add(simd_div(pab_norm, spacing), simd_set1(1.0f)));
+      samples = simd_min(simd_max(samples, min_samples), max_samples);
+      simd_store(lanes, samples);
+      max_t = (int)*std::max_element(lanes, lanes + SIMD_WIDTH);
+    }
+
+    simd_float integral = simd_set1(0.0f);
+    for (int t = 0; t < max_t; t++)
+    {
+      // Integral Point T
+      simd_float progress = sample_spacing > 0.0f ? simd_div(simd_set1((float)t), samples)
+                                                  : simd_set1((float)t / (float)num_integral_samples);
+      simd_float pt_i = simd_add(pa_i, simd_mul(progress, pab_i));
+      simd_float pt_j = simd_add(pa_j, simd_mul(progress, pab_j));
+
+      // Vector at integral point
+      simd_mask valid = simd_cmp_lt(simd_set1((float)t), samples);
+      simd_float pt_paf_i, pt_paf_j;
+      sample_paf(paf_i, paf_j, H, W, sampling, pt_i, pt_j, valid, pt_paf_i, pt_paf_j);
+
+      // Dot Product Normalized A->B with PAF Vector
+      simd_float dot = simd_add(simd_mul(pt_paf_i, uab_i), simd_mul(pt_paf_j, uab_j));
+      integral = simd_add(integral, simd_masked(dot, valid));
+    }
+
+    // Normalize the integral with respect to the number of samples
+    simd_store(pairs.scores + p, simd_div(integral, samples));
+  }
+
+  for (int a = 0; a < counts_a; a++)
+    std::copy(pairs.scores + a * counts_b, pairs.scores + (a + 1) * counts_b, score_graph_nk[a]);
+}
+
+template <class Skeleton>
+void paf_score_graph(PostProcessWorkspace &workspace, void *paf_data,
+                     NvDsInferDims &paf_dims, int num_integral_samples,
+                     PafSampling sampling, float sample_spacing,
+                     const TensorFormat &paf_format = TensorFormat())
 {
-  int K = topology.size();
-  int C = counts.size();
+  with_tensor(paf_data, paf_format, [&](auto paf) {
+    for (int k = 0; k < Skeleton::NUM_LINKS; k++)
+      paf_score_link<Skeleton>(workspace, k, paf, paf_dims, num_integral_samples,
+                               sampling, sample_spacing);
+  });
+}
 
-  Vec2D<int> visited(C, Vec1D<int>(max_count, 0));
+/*
+ This method takes care of solving the graph assignment problem of every link. The solvers are defined in
+ 'assignment_solver.cpp', Munkres algorithm itself in 'munkres_algorithm.cpp'
+ */
 
-  Vec2D<int> objects(max_count, Vec1D<int>(C, -1));
+template <class Skeleton>
+void assignment_link(PostProcessWorkspace &workspace, int k, float score_threshold,
+                     const AssignmentSolver &solver, bool prune)
+{
+  int max_count = workspace.max_count;
+
+  int cmap_a_idx = Skeleton::links[k].part_a;
+  int cmap_b_idx = Skeleton::links[k].part_b;
+  int nrows = workspace.counts[cmap_a_idx];
+  int ncols = workspace.counts[cmap_b_idx];
+  MatrixView<float> score_graph_a_nk = workspace.score_graph(k);
+
+  auto &star_graph = workspace.star_graphs[k];
+  solver.solve(score_graph_a_nk, nrows, ncols, score_threshold, prune,
+               workspace.assignment_scratch[k], star_graph);
+
+  int *connections_a_nk_0 = workspace.connection(k, 0);
+  int *connections_a_nk_1 = workspace.connection(k, 1);
+  std::fill(connections_a_nk_0, connections_a_nk_0 + max_count, -1);
+  std::fill(connections_a_nk_1, connections_a_nk_1 + max_count, -1);
+
+  for (int i = 0; i < nrows; i++)
+  {
+    int j = star_graph.colForRow(i);
+    if (j >= 0 && score_graph_a_nk[i][j] > score_threshold)
+    {
+      connections_a_nk_0[i] = j;
+      connections_a_nk_1[j] = i;
+    }
+  }
+}
+
+template <class Skeleton>
+void assignment(PostProcessWorkspace &workspace, float score_threshold,
+                const AssignmentSolver &solver, bool prune)
+{
+  for (int k = 0; k < Skeleton::NUM_LINKS; k++)
+    assignment_link<Skeleton>(workspace, k, score_threshold, solver, prune);
+}
+
+/* This method takes care of connecting all the body parts detected to each other 
+   after finding the relationships between them in the 'assignment' method. Only the links
+   incident to a part are visited, in the same order as a scan over all links. */
+template <class Skeleton>
+int connect_parts(PostProcessWorkspace &workspace)
+{
+  const SkeletonAdjacency<Skeleton> &adjacency = SkeletonTraits<Skeleton>::adjacency;
+  const int C = Skeleton::NUM_PARTS;
+  int max_count = workspace.max_count;
+  int max_objects = workspace.max_objects;
+
+  std::fill(workspace.visited.begin(), workspace.visited.end(), 0);
+  std::fill(workspace.objects.begin(), workspace.objects.end(), -1);
+  std::pair<int, int> *q = workspace.bfs_queue.data();
 
   int num_objects = 0;
   for (int c = 0; c < C; c++)
   {
-    if (num_objects >= max_count)
+    if (num_objects >= max_objects)
     {
       break;
     }
 
-    int count = counts[c];
+    int count = workspace.counts[c];
 
     for (int i = 0; i < count; i++)
     {
-      if (num_objects >= max_count)
+      if (num_objects >= max_objects)
       {
         break;
       }
 
-      std::queue<std::pair<int, int>> q;
+      int q_head = 0;
+      int q_tail = 0;
       bool new_object = false;
-      q.push({c, i});
+      int *object = workspace.object(num_objects);
+      q[q_tail++] = {c, i};
 
-      while (!q.empty())
+      while (q_head < q_tail)
       {
-        auto node = q.front();
-        q.pop();
+        auto node = q[q_head++];
         int c_n = node.first;
         int i_n = node.second;
 
-        if (visited[c_n][i_n])
+        if (workspace.visited[c_n * max_count + i_n])
         {
           continue;
         }
 
-        visited[c_n][i_n] = 1;
+        workspace.visited[c_n * max_count + i_n] = 1;
         new_object = true;
-        objects[num_objects][c_n] = i_n;
+        object[c_n] = i_n;
 
-        for (int k = 0; k < K; k++)
+        for (int e = adjacency.offsets[c_n]; e < adjacency.offsets[c_n + 1]; e++)
         {
-          int c_a = topology[k][2];
-          int c_b = topology[k][3];
-
-          if (c_a == c_n)
-          {
-            int i_b = connections[k][0][i_n];
-            if (i_b >= 0)
-            {
-              q.push({c_b, i_b});
-            }
-          }
-
-          if (c_b == c_n)
+          const SkeletonEdge &edge = adjacency.edges[e];
+          int i_other = workspace.connection(edge.link, edge.side)[i_n];
+          if (i_other >= 0)
           {
-            int i_a = connections[k][1][i_n];
-            if (i_a >= 0)
-            {
-              q.push({c_a, i_a});
-            }
+            q[q_tail++] = {edge.other_part, i_other};
           }
         }
       }
@@ -409,6 +1179,160 @@ connect_parts(
     }
   }
 
-  objects.resize(num_objects);
-  return objects;
-}
\ No newline at end of file
+  workspace.num_objects = num_objects;
+  return num_objects;
+}
+
+/* Inputs of the frame a workspace's task graph is currently processing */
+struct FrameTaskInputs
+{
+  PostProcessWorkspace *workspace;
+  void *cmap_data;
+  NvDsInferDims *cmap_dims;
+  void *paf_data;
+  NvDsInferDims *paf_dims;
+  const TensorFormat *cmap_format;
+  const TensorFormat *paf_format;
+  const PostProcessParams *params;
+  PeakSearchState *search_state;
+  std::atomic<int64_t> *stage_ns; /* time of every stage summed over the tasks, with metrics */
+};
+
+static inline void add_stage_time(FrameTaskInputs &in, PoseMetricStage stage, int64_t ns)
+{
+  if (ns >= 0)
+    in.stage_ns[stage].fetch_add(ns, std::memory_order_relaxed);
+}
+
+/* Peak detection and refinement of one cmap channel */
+static void run_channel_task(Task *task)
+{
+  FrameTaskInputs &in = *(FrameTaskInputs *)task->context;
+  const PostProcessParams &params = *in.params;
+  int c = task->index;
+  StageClock clock;
+
+  with_tensor(in.cmap_data, *in.cmap_format, [&](auto cmap) {
+    detect_peaks_channel(*in.workspace, c, cmap, *in.cmap_dims, params, in.search_state);
+    add_stage_time(in, METRIC_FIND_PEAKS, clock.split());
+    refine_peaks_channel(*in.workspace, c, cmap, *in.cmap_dims, params.window_size);
+    add_stage_time(in, METRIC_REFINE_PEAKS, clock.split());
+  });
+}
+
+/* PAF scoring and assignment of one skeleton link, runs once both of its channels are refined */
+template <class Skeleton>
+static void run_link_task(Task *task)
+{
+  FrameTaskInputs &in = *(FrameTaskInputs *)task->context;
+  const PostProcessParams &params = *in.params;
+  int k = task->index - Skeleton::NUM_PARTS;
+  StageClock clock;
+
+  with_tensor(in.paf_data, *in.paf_format, [&](auto paf) {
+    paf_score_link<Skeleton>(*in.workspace, k, paf, *in.paf_dims, params.num_integral_samples,
+                             params.paf_sampling, params.paf_sample_spacing);
+  });
+  add_stage_time(in, METRIC_PAF_SCORE_GRAPH, clock.split());
+  assignment_link<Skeleton>(*in.workspace, k, params.link_threshold,
+                            assignment_solver(params.solver), params.prune_links);
+  add_stage_time(in, METRIC_ASSIGNMENT, clock.split());
+}
+
+/* Builds the intra-frame graph of a workspace: one task per cmap channel, then one task per
+   link depending only on the two parts it joins. Each task writes its own slice of the
+   workspace, so the result does not depend on the execution order. */
+template <class Skeleton>
+static void build_frame_task_graph(PostProcessWorkspace &workspace)
+{
+  const int C = Skeleton::NUM_PARTS;
+  const int K = Skeleton::NUM_LINKS;
+  TaskGraph &graph = workspace.task_graph;
+
+  if (graph.size() == C + K && graph.task(C).run == run_link_task<Skeleton>)
+    return;
+
+  graph.resize(C + K);
+  for (int c = 0; c < C; c++)
+    graph.task(c).run = run_channel_task;
+  for (int k = 0; k < K; k++)
+  {
+    const SkeletonLink &link = Skeleton::links[k];
+    graph.task(C + k).run = run_link_task<Skeleton>;
+    graph.addDependency(link.part_a, C + k);
+    if (link.part_b != link.part_a)
+      graph.addDependency(link.part_b, C + k);
+  }
+}
+
+/* Runs every stage up to 'connect_parts' on 'scheduler', or serially on the calling thread
+   when no scheduler is given. The tensors must have Skeleton::NUM_PARTS cmap and
+   2 * Skeleton::NUM_LINKS paf channels. 'search_state' enables the incremental peak search
+   of the stream the frame belongs to, see 'detect_peaks'. The formats give the element type
+   of each tensor, float32 by default.
+
+   With pose_metrics() enabled, the time of every stage is recorded once per frame, summed
+   over the tasks that ran it, along with the peak and person counts. */
+template <class Skeleton>
+int run_post_process(PostProcessWorkspace &workspace, TaskScheduler *scheduler,
+                     void *cmap_data, NvDsInferDims &cmap_dims,
+                     void *paf_data, NvDsInferDims &paf_dims,
+                     const PostProcessParams &params, PeakSearchState *search_state = nullptr,
+                     const TensorFormat &cmap_format = TensorFormat(),
+                     const TensorFormat &paf_format = TensorFormat())
+{
+  StageClock clock;
+  if (!scheduler)
+  {
+    /* Finding peaks within a given window */
+    detect_peaks(workspace, cmap_data, cmap_dims, params, search_state, cmap_format);
+    clock.lap(METRIC_FIND_PEAKS);
+    /* Non-Maximum Suppression */
+    refine_peaks(workspace, cmap_data, cmap_dims, params.window_size, cmap_format);
+    clock.lap(METRIC_REFINE_PEAKS);
+    /* Create a Bipartite graph to assign detected body-parts to a unique person in the frame */
+    paf_score_graph<Skeleton>(workspace, paf_data, paf_dims, params.num_integral_samples,
+                              params.paf_sampling, params.paf_sample_spacing, paf_format);
+    clock.lap(METRIC_PAF_SCORE_GRAPH);
+    /* Assign weights to all edges in the bipartite graph generated */
+    assignment<Skeleton>(workspace, params.link_threshold,
+                         assignment_solver(params.solver), params.prune_links);
+    clock.lap(METRIC_ASSIGNMENT);
+  }
+  else
+  {
+    if (params.full_scan_interval <= 0)
+      search_state = nullptr;
+    if (search_state)
+      search_state->beginFrame(cmap_dims.d[0], cmap_dims.d[1], cmap_dims.d[2], workspace.max_count,
+                               params.full_scan_interval);
+
+    std::atomic<int64_t> stage_ns[NUM_METRIC_STAGES] = {};
+    FrameTaskInputs inputs = {&workspace, cmap_data, &cmap_dims, paf_data, &paf_dims, &cmap_format,
+                              &paf_format, &params, search_state, stage_ns};
+    build_frame_task_graph<Skeleton>(workspace);
+    for (int i = 0; i < workspace.task_graph.size(); i++)
+      workspace.task_graph.task(i).context = &inputs;
+    scheduler->run(workspace.task_graph);
+
+    if (clock.split() >= 0)
+    {
+      for (int s = METRIC_FIND_PEAKS; s <= METRIC_ASSIGNMENT; s++)
+        pose_metrics().local().record((PoseMetricStage)s, stage_ns[s].load(std::memory_order_relaxed));
+    }
+  }
+
+  /* Connecting all the Body Parts and Forming a Human Skeleton */
+  int num_objects = connect_parts<Skeleton>(workspace);
+  clock.lap(METRIC_CONNECT_PARTS);
+
+  if (pose_metrics().isEnabled())
+  {
+    ThreadMetrics &metrics = pose_metrics().local();
+    for (int c = 0; c < Skeleton::NUM_PARTS && c < METRIC_MAX_CHANNELS; c++)
+      ThreadMetrics::add(metrics.peaks[c], workspace.counts[c]);
+    ThreadMetrics::add(metrics.frames, 1);
+    ThreadMetrics::add(metrics.persons, num_objects);
+  }
+  return num_objects;
+}
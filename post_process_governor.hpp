@@ -0,0 +1,177 @@
+#pragma once
+
+/* Works on PostProcessParams, include after post_process.cpp */
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+struct GovernorParams
+{
+  bool enabled = false;
+  double budget_ms = 8.0;        /* post-processing time a frame may take */
+  int degrade_after = 3;         /* consecutive frames over budget before a level is dropped */
+  int restore_after = 60;        /* consecutive frames with headroom before a level is restored */
+  double restore_headroom = 0.6; /* fraction of the budget a frame must stay under to count */
+};
+
+/**
+ * Trades post-processing quality for latency. Level 0 runs the configured
+ * parameters, every further level is cheaper than the previous one:
+ *
+ *   1  fewer PAF integral samples
+ *   2  even fewer samples, limb candidates pruned before the assignment
+ *   3  half the peak candidates per part
+ *   4  higher peak and link thresholds
+ *   5  a quarter of the peak candidates, thresholds raised further
+ *
+ * Frames report their post-processing time. 'degrade_after' frames in a row
+ * over the budget move one level down, 'restore_after' frames in a row under
+ * 'restore_headroom' of the budget move one level back up. When a restored
+ * level has to be dropped again right away, the wait before the next restore
+ * doubles, up to 16 times 'restore_after', so the governor does not oscillate
+ * in a scene that sits right at the budget.
+ *
+ * The parameter sets are built once by configure(); current() can be read from
+ * any thread while frames report from others.
+ */
+class PostProcessGovernor
+{
+public:
+  PostProcessGovernor()
+      : level(0), over(0), under(0), restore_wait(0), frames_since_restore(0), changes(0) {}
+
+  void configure(const PostProcessParams &base, const GovernorParams &params)
+  {
+    this->params = params;
+    this->levels.assign(NUM_LEVELS, base);
+    for (int l = 1; l < NUM_LEVELS; l++)
+    {
+      PostProcessParams &p = this->levels[l];
+      p = this->levels[l - 1];
+      switch (l)
+      {
+      case 1:
+        p.num_integral_samples = std::min(base.num_integral_samples, std::max(2, base.num_integral_samples - 2));
+        break;
+      case 2:
+        p.num_integral_samples = std::min(base.num_integral_samples, std::max(2, base.num_integral_samples - 4));
+        p.prune_links = true;
+        break;
+      case 3:
+        p.max_num_parts = std::min(base.max_num_parts, std::max(4, base.max_num_parts / 2));
+        break;
+      case 4:
+        p.threshold = raisedThreshold(base.threshold, 0.1f);
+        p.link_threshold = raisedThreshold(base.link_threshold, 0.05f);
+        break;
+      case 5:
+        p.max_num_parts = std::min(base.max_num_parts, std::max(2, base.max_num_parts / 4));
+        p.threshold = raisedThreshold(base.threshold, 0.2f);
+        p.link_threshold = raisedThreshold(base.link_threshold, 0.1f);
+        break;
+      }
+    }
+    this->restore_wait = params.restore_after;
+    this->frames_since_restore = INT64_MAX / 2;
+    this->over = 0;
+    this->under = 0;
+    this->level.store(0, std::memory_order_relaxed);
+  }
+
+  inline bool isEnabled() const
+  {
+    return this->params.enabled;
+  }
+
+  /* Parameters of the current level, valid until the next configure() */
+  inline const PostProcessParams &current() const
+  {
+    return this->levels[this->level.load(std::memory_order_relaxed)];
+  }
+
+  inline int currentLevel() const
+  {
+    return this->level.load(std::memory_order_relaxed);
+  }
+
+  /* Level changes since configure() */
+  long levelChanges()
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->changes;
+  }
+
+  /* Accounts one frame that took 'frame_us' to post-process, returns the level for the next one */
+  int report(int64_t frame_us)
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    int l = this->level.load(std::memory_order_relaxed);
+    double budget_us = this->params.budget_ms * 1000.0;
+    if (this->frames_since_restore < INT64_MAX / 2)
+      this->frames_since_restore++;
+
+    if (frame_us > budget_us)
+    {
+      this->under = 0;
+      if (++this->over >= this->params.degrade_after && l < NUM_LEVELS - 1)
+      {
+        /* Dropped again before the restored level proved itself */
+        if (this->frames_since_restore < this->restore_wait)
+          this->restore_wait = std::min(this->restore_wait * 2, this->params.restore_after * 16);
+        setLevel(l + 1);
+      }
+    }
+    else if (frame_us < budget_us * this->params.restore_headroom)
+    {
+      this->over = 0;
+      if (++this->under >= this->restore_wait && l > 0)
+      {
+        setLevel(l - 1);
+        this->frames_since_restore = 0;
+      }
+    }
+    else
+    {
+      this->over = 0;
+      this->under = 0;
+    }
+
+    /* A level that held for a while resets the restore backoff */
+    if (this->frames_since_restore >= 4 * this->restore_wait)
+      this->restore_wait = this->params.restore_after;
+    return this->level.load(std::memory_order_relaxed);
+  }
+
+  static const int NUM_LEVELS = 6;
+
+private:
+  /* 'base' raised by 'step' but kept below 1, where no peak or link would pass anymore.
+     A configured threshold above the cap is left as it is. */
+  static float raisedThreshold(float base, float step)
+  {
+    return std::max(base, std::min(base + step, 0.95f));
+  }
+
+  void setLevel(int l)
+  {
+    this->level.store(l, std::memory_order_relaxed);
+    this->over = 0;
+    this->under = 0;
+    this->changes++;
+  }
+
+  GovernorParams params;
+  std::vector<PostProcessParams> levels;
+  std::atomic<int> level;
+
+  std::mutex mutex;
+  int over;
+  int under;
+  int restore_wait;
+  int64_t frames_since_restore;
+  long changes;
+};
@@ -0,0 +1,247 @@
+#pragma once
+
+#include "matrix_view.hpp"
+#include "pair_graph.hpp"
+#include "assignment_solver.hpp"
+#include "task_scheduler.hpp"
+#include "simd.hpp"
+
+#include <vector>
+#include <utility>
+
+/* Structure of arrays over the (a, b) candidate pairs of a link, indexed a * counts_b + b */
+struct LinkPairs
+{
+  float *pa_i;
+  float *pa_j;
+  float *pb_i;
+  float *pb_j;
+  float *scores;
+};
+
+/**
+ * Preallocated, flat storage shared by every post-processing stage of one
+ * stream. Each stage reads and writes strided views into these buffers, so once
+ * the workspace has been sized for a stream no further heap allocation happens
+ * per frame.
+ */
+class PostProcessWorkspace
+{
+public:
+  PostProcessWorkspace()
+      : num_parts(0), num_links(0), height(0), width(0), max_count(0),
+        max_objects(0), num_objects(0), padded_pairs(0), candidate_stride(0),
+        pyramid_height(0), pyramid_width(0), pyramid_stride(0) {}
+
+  /**
+   * Sizes all buffers for 'num_parts' cmap channels of 'height' x 'width',
+   * 'num_links' topology links, 'max_count' peaks per channel and 'max_objects'
+   * people. Storage is only reallocated when one of the dimensions changes.
+   */
+  void reserve(int num_parts, int num_links, int height, int width, int max_count,
+               int max_objects)
+  {
+    if (num_parts == this->num_parts && num_links == this->num_links &&
+        height == this->height && width == this->width &&
+        max_count == this->max_count && max_objects == this->max_objects)
+    {
+      return;
+    }
+
+    this->num_parts = num_parts;
+    this->num_links = num_links;
+    this->height = height;
+    this->width = width;
+    this->max_count = max_count;
+    this->max_objects = max_objects;
+
+    counts.assign(num_parts, 0);
+    peaks.assign(num_parts * max_count * 2, 0);
+    peak_scratch.assign(num_parts * height * width, 0.0f);
+    candidate_stride = height * width + SIMD_WIDTH;
+    candidates.assign(num_parts * candidate_stride, 0);
+    pyramid_height = (height + 1) / 2;
+    pyramid_width = (width + 1) / 2;
+    pyramid_stride = pyramid_height * pyramid_width + ((pyramid_height + 1) / 2) * ((pyramid_width + 1) / 2);
+    pyramid.assign(num_parts * pyramid_stride, 0.0f);
+    refined_peaks.assign(num_parts * max_count * 2, 0.0f);
+    peak_scores.assign(num_parts * max_count, 0.0f);
+    score_graphs.assign(num_links * max_count * max_count, 0.0f);
+    padded_pairs = (max_count * max_count + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+    link_pair_data.assign(num_links * 5 * padded_pairs, 0.0f);
+    connections.assign(num_links * 2 * max_count, -1);
+    visited.assign(num_parts * max_count, 0);
+    objects.assign(max_objects * num_parts, -1);
+
+    /* Every node enters the BFS queue at most once per incident link, plus the seed */
+    bfs_queue.resize(2 * num_links * max_count + 1);
+
+    /* Each link owns its solver scratch so links can be assigned concurrently */
+    star_graphs.resize(num_links);
+    assignment_scratch.resize(num_links);
+    for (int k = 0; k < num_links; k++)
+    {
+      star_graphs[k].resize(max_count, max_count);
+      assignment_scratch[k].reserve(max_count);
+    }
+    num_objects = 0;
+  }
+
+  /* Integer (row, col) of peak 'p' in channel 'c' */
+  inline int *peak(int c, int p)
+  {
+    return &peaks[(c * max_count + p) * 2];
+  }
+
+  /* Flat indices of the pixels of channel 'c' above the peak threshold, with SIMD_WIDTH of slack */
+  inline int *peak_candidates(int c)
+  {
+    return &candidates[c * candidate_stride];
+  }
+
+  /* Max-pooled level of channel 'c' for the pyramid peak detector: level 1 holds the maximum of
+     every 2x2 block in pyramid_height x pyramid_width cells, level 2 that of every 4x4 block in
+     half as many rows and columns, rounded up. Blocks at the right and bottom border may be
+     partial. */
+  inline float *pyramid_level(int c, int level)
+  {
+    float *data = &pyramid[c * pyramid_stride];
+    return level == 1 ? data : data + pyramid_height * pyramid_width;
+  }
+
+  /* Normalized (y, x) of peak 'p' in channel 'c' */
+  inline float *refined_peak(int c, int p)
+  {
+    return &refined_peaks[(c * max_count + p) * 2];
+  }
+
+  /* Confidence map value at peak 'p' of channel 'c' */
+  inline float &peak_score(int c, int p)
+  {
+    return peak_scores[c * max_count + p];
+  }
+
+  /* Scores between the peaks of both ends of link 'k' */
+  inline MatrixView<float> score_graph(int k)
+  {
+    return MatrixView<float>(&score_graphs[k * max_count * max_count], max_count);
+  }
+
+  /* Candidate pairs of link 'k' laid out for the vectorized PAF scoring */
+  inline LinkPairs link_pairs(int k)
+  {
+    float *data = &link_pair_data[k * 5 * padded_pairs];
+    LinkPairs pairs = {data, data + padded_pairs, data + 2 * padded_pairs,
+                       data + 3 * padded_pairs, data + 4 * padded_pairs};
+    return pairs;
+  }
+
+  /* connection(k, 0)[a] is the peak of cmap_b joined to peak 'a' of cmap_a, connection(k, 1) the reverse */
+  inline int *connection(int k, int side)
+  {
+    return &connections[(k * 2 + side) * max_count];
+  }
+
+  /* Peak index of each part for person 'n', -1 when the part is missing */
+  inline int *object(int n)
+  {
+    return &objects[n * num_parts];
+  }
+
+  int num_parts;
+  int num_links;
+  int height;
+  int width;
+  int max_count;
+  int max_objects;
+  int num_objects;
+  int padded_pairs; /* max_count * max_count rounded up to whole SIMD vectors */
+  int candidate_stride;
+  int pyramid_height; /* rows and columns of pyramid level 1 */
+  int pyramid_width;
+  int pyramid_stride;
+
+  std::vector<int> counts;
+  std::vector<int> peaks;
+  std::vector<float> peak_scratch;
+  std::vector<int> candidates;
+  std::vector<float> pyramid;
+  std::vector<float> refined_peaks;
+  std::vector<float> peak_scores;
+  std::vector<float> score_graphs;
+  std::vector<float> link_pair_data;
+  std::vector<int> connections;
+  std::vector<int> visited;
+  std::vector<int> objects;
+  std::vector<std::pair<int, int>> bfs_queue;
+
+  std::vector<PairGraph> star_graphs;
+  std::vector<AssignmentScratch> assignment_scratch;
+
+  /* Intra-frame task graph, built on first use by the post-processing scheduler */
+  TaskGraph task_graph;
+};
+
+/**
+ * What the incremental peak search remembers of a stream between frames: the
+ * peaks of every channel in the previous frame and the cmap energy around them.
+ * Channels are only read around those peaks until the next full scan, which
+ * runs every 'full_scan_interval' frames or when the energy of a channel's
+ * regions changes too much. Like the workspace, it belongs to one stream and
+ * is sized on its first frame.
+ */
+class PeakSearchState
+{
+public:
+  PeakSearchState()
+      : num_parts(0), height(0), width(0), max_count(0), frames_since_full(0), full_scan(true) {}
+
+  /**
+   * Starts a frame: decides whether it gets a full scan, which is always the
+   * case for the first frame and after the tensor dimensions changed
+   */
+  void beginFrame(int num_parts, int height, int width, int max_count, int full_scan_interval)
+  {
+    if (num_parts != this->num_parts || height != this->height || width != this->width ||
+        max_count != this->max_count)
+    {
+      this->num_parts = num_parts;
+      this->height = height;
+      this->width = width;
+      this->max_count = max_count;
+      counts.assign(num_parts, 0);
+      peaks.assign(num_parts * max_count * 2, 0);
+      energies.assign(num_parts, 0.0f);
+      spans.assign(num_parts * max_count * 2, 0);
+      frames_since_full = full_scan_interval;
+    }
+
+    full_scan = ++frames_since_full >= full_scan_interval;
+    if (full_scan)
+      frames_since_full = 0;
+  }
+
+  /* Integer (row, col) of peak 'p' of channel 'c' in the previous frame */
+  inline int *peak(int c, int p)
+  {
+    return &peaks[(c * max_count + p) * 2];
+  }
+
+  /* Column intervals of one region row, scratch of channel 'c' */
+  inline int *regionSpans(int c)
+  {
+    return &spans[c * max_count * 2];
+  }
+
+  int num_parts;
+  int height;
+  int width;
+  int max_count;
+  int frames_since_full;
+  bool full_scan; /* the current frame scans every channel in full */
+
+  std::vector<int> counts;
+  std::vector<int> peaks;
+  std::vector<float> energies; /* cmap sum over each channel's regions */
+  std::vector<int> spans;
+};
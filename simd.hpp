@@ -0,0 +1,245 @@
+#pragma once
+
+/**
+ * Minimal float vector abstraction used by the vectorized post-processing
+ * kernels. The widest instruction set enabled at compile time is selected
+ * (AVX2, SSE2 or AArch64 NEON) with a scalar fallback, so the kernels are
+ * written once against SIMD_WIDTH lanes.
+ */
+
+#include <math.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define POSE_SIMD_AVX2 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define POSE_SIMD_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+/* AArch64 only: the kernels use across-vector adds, rounding and division that 32-bit NEON
+   lacks, so ARMv7 builds take the scalar path */
+#include <arm_neon.h>
+#define POSE_SIMD_NEON 1
+#endif
+
+#if defined(POSE_SIMD_AVX2)
+
+typedef __m256 simd_float;
+static const int SIMD_WIDTH = 8;
+
+inline simd_float simd_load(const float *p) { return _mm256_loadu_ps(p); }
+inline void simd_store(float *p, simd_float v) { _mm256_storeu_ps(p, v); }
+inline simd_float simd_set1(float v) { return _mm256_set1_ps(v); }
+inline simd_float simd_max(simd_float a, simd_float b) { return _mm256_max_ps(a, b); }
+inline simd_float simd_min(simd_float a, simd_float b) { return _mm256_min_ps(a, b); }
+inline simd_float simd_add(simd_float a, simd_float b) { return _mm256_add_ps(a, b); }
+inline simd_float simd_sub(simd_float a, simd_float b) { return _mm256_sub_ps(a, b); }
+inline simd_float simd_mul(simd_float a, simd_float b) { return _mm256_mul_ps(a, b); }
+inline simd_float simd_div(simd_float a, simd_float b) { return _mm256_div_ps(a, b); }
+inline simd_float simd_sqrt(simd_float v) { return _mm256_sqrt_ps(v); }
+
+/* Rounds toward zero like a cast to int */
+inline simd_float simd_trunc(simd_float v) { return _mm256_round_ps(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+
+/* Bit i of the result is set when a[i] >= b[i] */
+inline int simd_mask_ge(simd_float a, simd_float b)
+{
+  return _mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_GE_OQ));
+}
+
+/* Lane masks, all bits of a lane are set where the comparison holds */
+typedef __m256 simd_mask;
+inline simd_mask simd_cmp_ge(simd_float a, simd_float b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+inline simd_mask simd_cmp_lt(simd_float a, simd_float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+inline simd_mask simd_mask_and(simd_mask a, simd_mask b) { return _mm256_and_ps(a, b); }
+
+/* 'v' where 'm' is set, zero elsewhere */
+inline simd_float simd_masked(simd_float v, simd_mask m) { return _mm256_and_ps(v, m); }
+
+/* base[index[i]] for every lane, 'index' holds whole numbers */
+inline simd_float simd_gather(const float *base, simd_float index)
+{
+  return _mm256_i32gather_ps(base, _mm256_cvttps_epi32(index), 4);
+}
+
+/* Maximum of every adjacent pair of the 2 * SIMD_WIDTH values of 'a' followed by 'b' */
+inline simd_float simd_pair_max(simd_float a, simd_float b)
+{
+  /* Both shuffles work per 128-bit half, the permute restores the order of the halves */
+  __m256 m = _mm256_max_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+                           _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+  return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(m), _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+#elif defined(POSE_SIMD_SSE2)
+
+typedef __m128 simd_float;
+static const int SIMD_WIDTH = 4;
+
+inline simd_float simd_load(const float *p) { return _mm_loadu_ps(p); }
+inline void simd_store(float *p, simd_float v) { _mm_storeu_ps(p, v); }
+inline simd_float simd_set1(float v) { return _mm_set1_ps(v); }
+inline simd_float simd_max(simd_float a, simd_float b) { return _mm_max_ps(a, b); }
+inline simd_float simd_min(simd_float a, simd_float b) { return _mm_min_ps(a, b); }
+inline simd_float simd_add(simd_float a, simd_float b) { return _mm_add_ps(a, b); }
+inline simd_float simd_sub(simd_float a, simd_float b) { return _mm_sub_ps(a, b); }
+inline simd_float simd_mul(simd_float a, simd_float b) { return _mm_mul_ps(a, b); }
+inline simd_float simd_div(simd_float a, simd_float b) { return _mm_div_ps(a, b); }
+inline simd_float simd_sqrt(simd_float v) { return _mm_sqrt_ps(v); }
+inline simd_float simd_trunc(simd_float v) { return _mm_cvtepi32_ps(_mm_cvttps_epi32(v)); }
+
+inline int simd_mask_ge(simd_float a, simd_float b)
+{
+  return _mm_movemask_ps(_mm_cmpge_ps(a, b));
+}
+
+typedef __m128 simd_mask;
+inline simd_mask simd_cmp_ge(simd_float a, simd_float b) { return _mm_cmpge_ps(a, b); }
+inline simd_mask simd_cmp_lt(simd_float a, simd_float b) { return _mm_cmplt_ps(a, b); }
+inline simd_mask simd_mask_and(simd_mask a, simd_mask b) { return _mm_and_ps(a, b); }
+inline simd_float simd_masked(simd_float v, simd_mask m) { return _mm_and_ps(v, m); }
+
+/* No gather instruction before AVX2 */
+inline simd_float simd_gather(const float *base, simd_float index)
+{
+  alignas(16) float lanes[4];
+  _mm_store_ps(lanes, index);
+  return _mm_setr_ps(base[(int)lanes[0]], base[(int)lanes[1]], base[(int)lanes[2]],
+                     base[(int)lanes[3]]);
+}
+
+inline simd_float simd_pair_max(simd_float a, simd_float b)
+{
+  return _mm_max_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+}
+
+#elif defined(POSE_SIMD_NEON)
+
+typedef float32x4_t simd_float;
+static const int SIMD_WIDTH = 4;
+
+inline simd_float simd_load(const float *p) { return vld1q_f32(p); }
+inline void simd_store(float *p, simd_float v) { vst1q_f32(p, v); }
+inline simd_float simd_set1(float v) { return vdupq_n_f32(v); }
+inline simd_float simd_max(simd_float a, simd_float b) { return vmaxq_f32(a, b); }
+inline simd_float simd_min(simd_float a, simd_float b) { return vminq_f32(a, b); }
+inline simd_float simd_add(simd_float a, simd_float b) { return vaddq_f32(a, b); }
+inline simd_float simd_sub(simd_float a, simd_float b) { return vsubq_f32(a, b); }
+inline simd_float simd_mul(simd_float a, simd_float b) { return vmulq_f32(a, b); }
+inline simd_float simd_div(simd_float a, simd_float b) { return vdivq_f32(a, b); }
+inline simd_float simd_sqrt(simd_float v) { return vsqrtq_f32(v); }
+inline simd_float simd_trunc(simd_float v) { return vrndq_f32(v); }
+
+inline int simd_mask_ge(simd_float a, simd_float b)
+{
+  static const uint32_t bits[4] = {1, 2, 4, 8};
+  uint32x4_t m = vandq_u32(vcgeq_f32(a, b), vld1q_u32(bits));
+  return vaddvq_u32(m);
+}
+
+typedef uint32x4_t simd_mask;
+inline simd_mask simd_cmp_ge(simd_float a, simd_float b) { return vcgeq_f32(a, b); }
+inline simd_mask simd_cmp_lt(simd_float a, simd_float b) { return vcltq_f32(a, b); }
+inline simd_mask simd_mask_and(simd_mask a, simd_mask b) { return vandq_u32(a, b); }
+inline simd_float simd_masked(simd_float v, simd_mask m)
+{
+  return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(v), m));
+}
+
+inline simd_float simd_gather(const float *base, simd_float index)
+{
+  float lanes[4];
+  vst1q_f32(lanes, index);
+  float values[4] = {base[(int)lanes[0]], base[(int)lanes[1]], base[(int)lanes[2]],
+                     base[(int)lanes[3]]};
+  return vld1q_f32(values);
+}
+
+inline simd_float simd_pair_max(simd_float a, simd_float b)
+{
+  float32x4x2_t halves = vuzpq_f32(a, b);
+  return vmaxq_f32(halves.val[0], halves.val[1]);
+}
+
+#else
+
+typedef float simd_float;
+static const int SIMD_WIDTH = 1;
+
+inline simd_float simd_load(const float *p) { return *p; }
+inline void simd_store(float *p, simd_float v) { *p = v; }
+inline simd_float simd_set1(float v) { return v; }
+inline simd_float simd_max(simd_float a, simd_float b) { return a > b ? a : b; }
+inline simd_float simd_min(simd_float a, simd_float b) { return a < b ? a : b; }
+inline simd_float simd_add(simd_float a, simd_float b) { return a + b; }
+inline simd_float simd_sub(simd_float a, simd_float b) { return a - b; }
+inline simd_float simd_mul(simd_float a, simd_float b) { return a * b; }
+inline simd_float simd_div(simd_float a, simd_float b) { return a / b; }
+inline simd_float simd_sqrt(simd_float v) { return sqrtf(v); }
+inline simd_float simd_trunc(simd_float v) { return (float)(int)v; }
+inline int simd_mask_ge(simd_float a, simd_float b) { return a >= b; }
+
+typedef bool simd_mask;
+inline simd_mask simd_cmp_ge(simd_float a, simd_float b) { return a >= b; }
+inline simd_mask simd_cmp_lt(simd_float a, simd_float b) { return a < b; }
+inline simd_mask simd_mask_and(simd_mask a, simd_mask b) { return a && b; }
+inline simd_float simd_masked(simd_float v, simd_mask m) { return m ? v : 0.0f; }
+inline simd_float simd_gather(const float *base, simd_float index) { return base[(int)index]; }
+inline simd_float simd_pair_max(simd_float a, simd_float b) { return a > b ? a : b; }
+
+#endif
+
+/* Index of the lowest set bit of a non-zero lane mask */
+inline int simd_mask_first(int mask)
+{
+  return __builtin_ctz(mask);
+}
+
+/* Lane numbers of the set bits of every lane mask, lowest first: the shuffle table of a
+   compress-store, built at compile time */
+template <int Width>
+struct SimdCompressTable
+{
+  constexpr SimdCompressTable() : lanes{}
+  {
+    for (int mask = 0; mask < (1 << Width); mask++)
+    {
+      int n = 0;
+      for (int lane = 0; lane < Width; lane++)
+      {
+        if (mask & (1 << lane))
+          lanes[mask][n++] = lane;
+      }
+    }
+  }
+
+  int lanes[1 << Width][Width];
+};
+
+template <class Unused = void>
+struct SimdTables
+{
+  static constexpr SimdCompressTable<SIMD_WIDTH> compress = SimdCompressTable<SIMD_WIDTH>();
+};
+
+template <class Unused>
+constexpr SimdCompressTable<SIMD_WIDTH> SimdTables<Unused>::compress;
+
+/* Compress-store: writes 'base + lane' for every lane set in 'mask' to 'out', packed, and
+   returns how many were written. 'out' must have room for SIMD_WIDTH entries. */
+inline int simd_compress_index(int *out, int base, int mask)
+{
+  const int *lanes = SimdTables<>::compress.lanes[mask];
+#if defined(POSE_SIMD_AVX2)
+  __m256i index = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)lanes), _mm256_set1_epi32(base));
+  _mm256_storeu_si256((__m256i *)out, index);
+#elif defined(POSE_SIMD_SSE2)
+  __m128i index = _mm_add_epi32(_mm_loadu_si128((const __m128i *)lanes), _mm_set1_epi32(base));
+  _mm_storeu_si128((__m128i *)out, index);
+#elif defined(POSE_SIMD_NEON)
+  vst1q_s32(out, vaddq_s32(vld1q_s32(lanes), vdupq_n_s32(base)));
+#else
+  out[0] = base + lanes[0];
+#endif
+  return __builtin_popcount(mask);
+}
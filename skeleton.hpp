@@ -0,0 +1,196 @@
+#pragma once
+
+#include <string.h>
+
+/**
+ * Skeletons are compile-time descriptions of a trt_pose style model: the number
+ * of confidence map channels (parts) and the links between them. Link k reads
+ * the PAF channels 'paf_i' and 'paf_j' and joins part 'part_a' to 'part_b'.
+ * The post-processing stages take the skeleton as a template parameter, so
+ * their part and link loops have constant trip counts.
+ *
+ * The tables are static members of class templates, which C++14 allows to be
+ * defined in a header without breaking the one definition rule.
+ */
+
+struct SkeletonLink
+{
+  int paf_i;
+  int paf_j;
+  int part_a;
+  int part_b;
+};
+
+/* 18 keypoint COCO body model (trt_pose human_pose.json) */
+template <class Unused = void>
+struct BodySkeletonTables
+{
+  static constexpr int NUM_PARTS = 18;
+  static constexpr int NUM_LINKS = 21;
+  static constexpr const char *NAME = "body";
+
+  static constexpr SkeletonLink links[NUM_LINKS] = {
+      {0, 1, 15, 13},
+      {2, 3, 13, 11},
+      {4, 5, 16, 14},
+      {6, 7, 14, 12},
+      {8, 9, 11, 12},
+      {10, 11, 5, 7},
+      {12, 13, 6, 8},
+      {14, 15, 7, 9},
+      {16, 17, 8, 10},
+      {18, 19, 1, 2},
+      {20, 21, 0, 1},
+      {22, 23, 0, 2},
+      {24, 25, 1, 3},
+      {26, 27, 2, 4},
+      {28, 29, 3, 5},
+      {30, 31, 4, 6},
+      {32, 33, 17, 0},
+      {34, 35, 17, 5},
+      {36, 37, 17, 6},
+      {38, 39, 17, 11},
+      {40, 41, 17, 12}};
+
+  static constexpr const char *part_names[NUM_PARTS] = {
+      "nose", "left_eye", "right_eye", "left_ear", "right_ear", "left_shoulder",
+      "right_shoulder", "left_elbow", "right_elbow", "left_wrist", "right_wrist",
+      "left_hip", "right_hip", "left_knee", "right_knee", "left_ankle", "right_ankle",
+      "neck"};
+};
+
+template <class Unused>
+constexpr int BodySkeletonTables<Unused>::NUM_PARTS;
+template <class Unused>
+constexpr int BodySkeletonTables<Unused>::NUM_LINKS;
+template <class Unused>
+constexpr const char *BodySkeletonTables<Unused>::NAME;
+template <class Unused>
+constexpr SkeletonLink BodySkeletonTables<Unused>::links[];
+template <class Unused>
+constexpr const char *BodySkeletonTables<Unused>::part_names[];
+
+typedef BodySkeletonTables<> BodySkeleton;
+
+/* 21 keypoint hand model (trt_pose_hand hand_pose.json) */
+template <class Unused = void>
+struct HandSkeletonTables
+{
+  static constexpr int NUM_PARTS = 21;
+  static constexpr int NUM_LINKS = 20;
+  static constexpr const char *NAME = "hand";
+
+  static constexpr SkeletonLink links[NUM_LINKS] = {
+      {0, 1, 0, 4},
+      {2, 3, 0, 8},
+      {4, 5, 0, 12},
+      {6, 7, 0, 16},
+      {8, 9, 0, 20},
+      {10, 11, 1, 2},
+      {12, 13, 2, 3},
+      {14, 15, 3, 4},
+      {16, 17, 5, 6},
+      {18, 19, 6, 7},
+      {20, 21, 7, 8},
+      {22, 23, 9, 10},
+      {24, 25, 10, 11},
+      {26, 27, 11, 12},
+      {28, 29, 13, 14},
+      {30, 31, 14, 15},
+      {32, 33, 15, 16},
+      {34, 35, 17, 18},
+      {36, 37, 18, 19},
+      {38, 39, 19, 20}};
+
+  static constexpr const char *part_names[NUM_PARTS] = {
+      "palm", "thumb_1", "thumb_2", "thumb_3", "thumb_4", "index_finger_1",
+      "index_finger_2", "index_finger_3", "index_finger_4", "middle_finger_1",
+      "middle_finger_2", "middle_finger_3", "middle_finger_4", "ring_finger_1",
+      "ring_finger_2", "ring_finger_3", "ring_finger_4", "baby_finger_1",
+      "baby_finger_2", "baby_finger_3", "baby_finger_4"};
+};
+
+template <class Unused>
+constexpr int HandSkeletonTables<Unused>::NUM_PARTS;
+template <class Unused>
+constexpr int HandSkeletonTables<Unused>::NUM_LINKS;
+template <class Unused>
+constexpr const char *HandSkeletonTables<Unused>::NAME;
+template <class Unused>
+constexpr SkeletonLink HandSkeletonTables<Unused>::links[];
+template <class Unused>
+constexpr const char *HandSkeletonTables<Unused>::part_names[];
+
+typedef HandSkeletonTables<> HandSkeleton;
+
+/* One end of a link as seen from a part: the link and the side the part sits on */
+struct SkeletonEdge
+{
+  int link;
+  int side;       /* 0 when the part is 'part_a', 1 when it is 'part_b' */
+  int other_part; /* part at the opposite end */
+};
+
+/**
+ * Links incident to every part in compressed rows, built at compile time.
+ * The edges of part c are edges[offsets[c]] to edges[offsets[c + 1] - 1], in
+ * link order, with side 0 before side 1 of the same link.
+ */
+template <class Skeleton>
+struct SkeletonAdjacency
+{
+  constexpr SkeletonAdjacency() : offsets{}, edges{}
+  {
+    for (int k = 0; k < Skeleton::NUM_LINKS; k++)
+    {
+      offsets[Skeleton::links[k].part_a + 1]++;
+      offsets[Skeleton::links[k].part_b + 1]++;
+    }
+    for (int c = 0; c < Skeleton::NUM_PARTS; c++)
+      offsets[c + 1] += offsets[c];
+
+    int fill[Skeleton::NUM_PARTS] = {};
+    for (int k = 0; k < Skeleton::NUM_LINKS; k++)
+    {
+      const SkeletonLink &link = Skeleton::links[k];
+      SkeletonEdge &a = edges[offsets[link.part_a] + fill[link.part_a]++];
+      a.link = k;
+      a.side = 0;
+      a.other_part = link.part_b;
+      SkeletonEdge &b = edges[offsets[link.part_b] + fill[link.part_b]++];
+      b.link = k;
+      b.side = 1;
+      b.other_part = link.part_a;
+    }
+  }
+
+  int offsets[Skeleton::NUM_PARTS + 1];
+  SkeletonEdge edges[2 * Skeleton::NUM_LINKS];
+};
+
+template <class Skeleton>
+struct SkeletonTraits
+{
+  static constexpr SkeletonAdjacency<Skeleton> adjacency = SkeletonAdjacency<Skeleton>();
+};
+
+template <class Skeleton>
+constexpr SkeletonAdjacency<Skeleton> SkeletonTraits<Skeleton>::adjacency;
+
+/* Skeletons selectable at runtime, each one instantiates its own post-processing */
+enum SkeletonType
+{
+  SKELETON_BODY = 0,
+  SKELETON_HAND
+};
+
+inline bool skeleton_from_string(const char *name, SkeletonType &type)
+{
+  if (!strcmp(name, BodySkeleton::NAME))
+    type = SKELETON_BODY;
+  else if (!strcmp(name, HandSkeleton::NAME))
+    type = SKELETON_HAND;
+  else
+    return false;
+  return true;
+}
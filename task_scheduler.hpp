@@ -0,0 +1,345 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskGraph;
+
+/**
+ * A node of a TaskGraph. 'run' is called once per TaskScheduler::run with the
+ * task itself, so 'context' and 'index' tell it which piece of work to do.
+ */
+struct Task
+{
+  void (*run)(Task *task);
+  void *context;
+  int index;
+
+  TaskGraph *graph;
+  int num_dependencies;
+  std::atomic<int> pending;
+  std::vector<Task *> successors;
+};
+
+/**
+ * Static dependency graph that is built once and executed many times. Running
+ * it again only resets the dependency counters, so execution never allocates.
+ */
+class TaskGraph
+{
+public:
+  TaskGraph() : remaining(0), num_tasks(0) {}
+
+  /**
+   * Creates 'num_tasks' tasks without dependencies, dropping the previous graph
+   */
+  void resize(int num_tasks)
+  {
+    this->tasks.reset(new Task[num_tasks]);
+    this->num_tasks = num_tasks;
+    for (int i = 0; i < num_tasks; i++)
+    {
+      Task &task = this->tasks[i];
+      task.run = nullptr;
+      task.context = nullptr;
+      task.index = i;
+      task.graph = this;
+      task.num_dependencies = 0;
+      task.pending = 0;
+    }
+  }
+
+  inline Task &task(int i)
+  {
+    return this->tasks[i];
+  }
+
+  /**
+   * Task 'after' only starts once task 'before' has finished
+   */
+  void addDependency(int before, int after)
+  {
+    this->tasks[before].successors.push_back(&this->tasks[after]);
+    this->tasks[after].num_dependencies++;
+  }
+
+  inline int size() const
+  {
+    return this->num_tasks;
+  }
+
+  std::atomic<int> remaining;
+
+private:
+  std::unique_ptr<Task[]> tasks;
+  int num_tasks;
+};
+
+/**
+ * Work-stealing pool executing TaskGraphs. Every worker owns a deque: it pushes
+ * and pops ready tasks at the bottom and idle workers steal from the top of the
+ * others. The deques are small ring buffers behind a mutex each, not lock-free;
+ * a push only touches the shared sleep mutex when some thread is asleep. The
+ * thread calling run() takes part in the execution, which also makes nested
+ * run() calls from inside a task safe. Outside callers borrow one of a few
+ * extra deques for the duration of run(), sharing the last one once the others
+ * are taken, and once they find nothing to help with they sleep until their
+ * graph completes or new work is queued.
+ */
+class TaskScheduler
+{
+public:
+  explicit TaskScheduler(int num_threads)
+      : stopping(false), num_queued(0), num_sleeping(0), num_waiting(0)
+  {
+    /* One deque per pool thread plus some for outside callers, the last of which is shared
+       once the others are taken */
+    this->num_threads = num_threads;
+    this->num_deques = num_threads + EXTERNAL_DEQUES;
+    this->deques.reset(new Deque[this->num_deques]);
+    for (int i = 0; i < num_threads; i++)
+    {
+      this->threads.emplace_back(&TaskScheduler::workerLoop, this, i);
+    }
+  }
+
+  ~TaskScheduler()
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->sleep_mutex);
+      this->stopping = true;
+    }
+    this->sleep_cond.notify_all();
+    for (auto &thread : this->threads)
+    {
+      thread.join();
+    }
+  }
+
+  inline int numThreads() const
+  {
+    return (int)this->threads.size();
+  }
+
+  /**
+   * Executes every task of 'graph' respecting its dependencies and returns
+   * once all of them have finished
+   */
+  void run(TaskGraph &graph)
+  {
+    int n = graph.size();
+    graph.remaining = n;
+    for (int i = 0; i < n; i++)
+    {
+      graph.task(i).pending = graph.task(i).num_dependencies;
+    }
+
+    WorkerId &worker = currentWorker();
+    WorkerId outer = worker;
+    int self = outer.scheduler == this ? outer.index : claimExternalDeque();
+    worker = {this, self};
+
+    for (int i = 0; i < n; i++)
+    {
+      if (graph.task(i).num_dependencies == 0)
+      {
+        push(self, &graph.task(i));
+      }
+    }
+
+    int idle = 0;
+    while (graph.remaining.load(std::memory_order_acquire) > 0)
+    {
+      Task *task = pop(self);
+      if (!task)
+        task = steal(self);
+      if (task)
+      {
+        execute(self, task);
+        idle = 0;
+      }
+      else if (++idle < MAX_IDLE_SPINS)
+      {
+        std::this_thread::yield();
+      }
+      else
+      {
+        /* The remaining tasks run elsewhere: sleep like an idle worker, but also wake for the
+           graph's completion. New work still wakes the caller, whose help a nested run()
+           inside the other tasks may need. */
+        std::unique_lock<std::mutex> lock(this->sleep_mutex);
+        this->num_waiting.fetch_add(1);
+        this->num_sleeping.fetch_add(1);
+        this->sleep_cond.wait(lock, [this, &graph] {
+          return graph.remaining.load() == 0 || this->num_queued.load() > 0;
+        });
+        this->num_sleeping.fetch_sub(1);
+        this->num_waiting.fetch_sub(1);
+        idle = 0;
+      }
+    }
+
+    worker = outer;
+    if (outer.scheduler != this && self < this->num_deques - 1)
+      this->deques[self].claimed.store(false, std::memory_order_release);
+  }
+
+private:
+  static const int DEQUE_CAPACITY = 1024;
+  static const int EXTERNAL_DEQUES = 8;
+  static const int MAX_IDLE_SPINS = 64;
+
+  struct Deque
+  {
+    Deque() : top(0), bottom(0), claimed(false) {}
+
+    std::mutex mutex;
+    Task *tasks[DEQUE_CAPACITY];
+    long top;
+    long bottom;
+    std::atomic<bool> claimed; /* outside deques: in use by a run() call */
+  };
+
+  struct WorkerId
+  {
+    TaskScheduler *scheduler;
+    int index;
+  };
+
+  static WorkerId &currentWorker()
+  {
+    static thread_local WorkerId worker = {nullptr, -1};
+    return worker;
+  }
+
+  /* Deque of an outside caller of run(), the shared last one when all others are taken */
+  int claimExternalDeque()
+  {
+    for (int i = this->num_threads; i < this->num_deques - 1; i++)
+    {
+      if (!this->deques[i].claimed.exchange(true, std::memory_order_acquire))
+        return i;
+    }
+    return this->num_deques - 1;
+  }
+
+  void push(int self, Task *task)
+  {
+    Deque &deque = this->deques[self];
+    {
+      std::lock_guard<std::mutex> lock(deque.mutex);
+      if (deque.bottom - deque.top < DEQUE_CAPACITY)
+      {
+        deque.tasks[deque.bottom % DEQUE_CAPACITY] = task;
+        deque.bottom++;
+        task = nullptr;
+      }
+    }
+
+    /* Deque full: run the task right away instead of growing */
+    if (task)
+    {
+      execute(self, task);
+      return;
+    }
+
+    /* Sequentially consistent with the 'num_sleeping' update of the sleepers, so either the
+       sleeper sees the task or the push sees the sleeper and locks to wake it */
+    this->num_queued.fetch_add(1);
+    if (this->num_sleeping.load() > 0)
+    {
+      {
+        std::lock_guard<std::mutex> lock(this->sleep_mutex);
+      }
+      this->sleep_cond.notify_one();
+    }
+  }
+
+  Task *pop(int self)
+  {
+    Deque &deque = this->deques[self];
+    std::lock_guard<std::mutex> lock(deque.mutex);
+    if (deque.bottom == deque.top)
+      return nullptr;
+    deque.bottom--;
+    this->num_queued.fetch_sub(1, std::memory_order_relaxed);
+    return deque.tasks[deque.bottom % DEQUE_CAPACITY];
+  }
+
+  Task *steal(int self)
+  {
+    for (int offset = 1; offset < this->num_deques; offset++)
+    {
+      Deque &deque = this->deques[(self + offset) % this->num_deques];
+      std::lock_guard<std::mutex> lock(deque.mutex);
+      if (deque.bottom != deque.top)
+      {
+        Task *task = deque.tasks[deque.top % DEQUE_CAPACITY];
+        deque.top++;
+        this->num_queued.fetch_sub(1, std::memory_order_relaxed);
+        return task;
+      }
+    }
+    return nullptr;
+  }
+
+  void execute(int self, Task *task)
+  {
+    task->run(task);
+    for (Task *successor : task->successors)
+    {
+      if (successor->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      {
+        push(self, successor);
+      }
+    }
+    /* Sequentially consistent with the 'num_waiting' update of run(), so either the waiter
+       sees the graph completed or the completion sees the waiter */
+    if (task->graph->remaining.fetch_sub(1) == 1 && this->num_waiting.load() > 0)
+    {
+      {
+        std::lock_guard<std::mutex> lock(this->sleep_mutex);
+      }
+      this->sleep_cond.notify_all();
+    }
+  }
+
+  void workerLoop(int index)
+  {
+    currentWorker() = {this, index};
+    while (true)
+    {
+      Task *task = pop(index);
+      if (!task)
+        task = steal(index);
+      if (task)
+      {
+        execute(index, task);
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(this->sleep_mutex);
+      this->num_sleeping.fetch_add(1);
+      this->sleep_cond.wait(lock, [this] { return this->stopping || this->num_queued.load() > 0; });
+      this->num_sleeping.fetch_sub(1);
+      if (this->stopping)
+        return;
+    }
+  }
+
+  std::vector<std::thread> threads;
+  std::unique_ptr<Deque[]> deques;
+  int num_threads;
+  int num_deques;
+
+  std::mutex sleep_mutex;
+  std::condition_variable sleep_cond;
+  bool stopping;
+  std::atomic<int> num_queued;
+  std::atomic<int> num_sleeping; /* workers and run() callers sleeping on 'sleep_cond' */
+  std::atomic<int> num_waiting;  /* run() callers sleeping on 'sleep_cond' */
+};
@@ -0,0 +1,370 @@
+#pragma once
+
+#ifdef POSE_POSTPROCESS_STANDALONE
+#include "nvdsinfer_standin.h"
+#else
+#include "gstnvdsinfer.h"
+#endif
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <vector>
+
+/**
+ * Append-only capture of nvinfer tensor outputs, one record per frame.
+ *
+ *   TensorCaptureHeader | record 0 | record 1 | ... | index
+ *
+ * Every record starts with a TensorCaptureRecord followed by the raw host
+ * buffers of its layers. Records and layer payloads are 64-byte aligned, so a
+ * memory-mapped file can be handed to the post-processing without copies. The
+ * index (one file offset per record) is written when the capture is closed;
+ * a file left without index is still readable by walking the records.
+ */
+
+#define TENSOR_CAPTURE_MAGIC "POSETNSR"
+#define TENSOR_CAPTURE_VERSION 1
+#define TENSOR_CAPTURE_RECORD_MAGIC 0x43455250 /* 'PREC' */
+#define TENSOR_CAPTURE_MAX_LAYERS 2
+#define TENSOR_CAPTURE_ALIGNMENT 64
+
+struct TensorCaptureHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t num_layers;
+  uint64_t index_offset; /* 0 until the capture is closed */
+  uint64_t num_records;
+  uint8_t reserved[32];
+};
+
+struct TensorCaptureLayer
+{
+  uint32_t data_type; /* NvDsInferDataType */
+  uint32_t num_dims;
+  uint32_t d[NVDSINFER_MAX_DIMS];
+  uint32_t num_elements;
+  uint32_t reserved;
+  uint64_t data_offset; /* from the start of the record */
+  uint64_t data_size;
+};
+
+struct TensorCaptureRecord
+{
+  uint32_t magic;
+  uint32_t source_id;
+  uint64_t frame_number;
+  uint64_t pts;
+  uint64_t record_size; /* header and payload, including padding */
+  uint32_t num_layers;
+  uint32_t reserved;
+  TensorCaptureLayer layers[TENSOR_CAPTURE_MAX_LAYERS];
+};
+
+static inline uint64_t
+tensor_capture_align(uint64_t size)
+{
+  return (size + TENSOR_CAPTURE_ALIGNMENT - 1) & ~(uint64_t)(TENSOR_CAPTURE_ALIGNMENT - 1);
+}
+
+static inline uint64_t
+tensor_capture_element_size(uint32_t data_type)
+{
+  switch (data_type)
+  {
+  case HALF:
+    return 2;
+  case INT8:
+    return 1;
+  default:
+    return 4;
+  }
+}
+
+class TensorCaptureWriter
+{
+public:
+  TensorCaptureWriter() : file(nullptr), offset(0) {}
+
+  ~TensorCaptureWriter()
+  {
+    close();
+  }
+
+  bool open(const char *path)
+  {
+    this->file = fopen(path, "wb");
+    if (!this->file)
+      return false;
+
+    TensorCaptureHeader header = makeHeader();
+    this->offset = 0;
+    this->index.clear();
+    return writePadded(&header, sizeof(header));
+  }
+
+  inline bool isOpen() const
+  {
+    return this->file != nullptr;
+  }
+
+  /**
+   * Appends the cmap and paf host buffers of 'tensor_meta'
+   */
+  bool write(NvDsInferTensorMeta *tensor_meta, uint32_t source_id, uint64_t frame_number,
+             uint64_t pts)
+  {
+    if (!this->file || tensor_meta->num_output_layers < TENSOR_CAPTURE_MAX_LAYERS)
+      return false;
+
+    TensorCaptureRecord record;
+    memset(&record, 0, sizeof(record));
+    record.magic = TENSOR_CAPTURE_RECORD_MAGIC;
+    record.source_id = source_id;
+    record.frame_number = frame_number;
+    record.pts = pts;
+    record.num_layers = TENSOR_CAPTURE_MAX_LAYERS;
+
+    uint64_t payload = tensor_capture_align(sizeof(record));
+    for (int i = 0; i < TENSOR_CAPTURE_MAX_LAYERS; i++)
+    {
+      NvDsInferLayerInfo &info = tensor_meta->output_layers_info[i];
+      TensorCaptureLayer &layer = record.layers[i];
+      layer.data_type = info.dataType;
+      layer.num_dims = info.inferDims.numDims;
+      memcpy(layer.d, info.inferDims.d, sizeof(layer.d));
+      layer.num_elements = info.inferDims.numElements;
+      layer.data_offset = payload;
+      layer.data_size = layer.num_elements * tensor_capture_element_size(layer.data_type);
+      payload = tensor_capture_align(payload + layer.data_size);
+    }
+    record.record_size = payload;
+
+    this->index.push_back(this->offset);
+    bool ok = writePadded(&record, sizeof(record));
+    for (int i = 0; i < TENSOR_CAPTURE_MAX_LAYERS && ok; i++)
+    {
+      ok = writePadded(tensor_meta->out_buf_ptrs_host[i], record.layers[i].data_size);
+    }
+    return ok;
+  }
+
+  /**
+   * Writes the index and patches the header, the file is complete afterwards.
+   * Returns false when finalizing failed; the records written so far can then
+   * still be recovered by the reader.
+   */
+  bool close()
+  {
+    if (!this->file)
+      return true;
+
+    TensorCaptureHeader header = makeHeader();
+    header.index_offset = this->offset;
+    header.num_records = this->index.size();
+    bool ok = fwrite(this->index.data(), sizeof(uint64_t), this->index.size(), this->file) == this->index.size();
+
+    /* The header only points at the index once the index is on disk */
+    ok = ok && fflush(this->file) == 0 && fseek(this->file, 0, SEEK_SET) == 0 &&
+         fwrite(&header, sizeof(header), 1, this->file) == 1;
+    ok = fclose(this->file) == 0 && ok;
+    this->file = nullptr;
+    return ok;
+  }
+
+private:
+  static TensorCaptureHeader makeHeader()
+  {
+    TensorCaptureHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TENSOR_CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = TENSOR_CAPTURE_VERSION;
+    header.num_layers = TENSOR_CAPTURE_MAX_LAYERS;
+    return header;
+  }
+
+  bool writePadded(const void *data, uint64_t size)
+  {
+    static const uint8_t zeros[TENSOR_CAPTURE_ALIGNMENT] = {0};
+    uint64_t padding = tensor_capture_align(size) - size;
+    if (fwrite(data, 1, size, this->file) != size ||
+        fwrite(zeros, 1, padding, this->file) != padding)
+      return false;
+    this->offset += size + padding;
+    return true;
+  }
+
+  FILE *file;
+  uint64_t offset;
+  std::vector<uint64_t> index;
+};
+
+/**
+ * A replayed frame. 'tensor_meta' has the layout nvinfer attaches to a frame and
+ * its host buffers point straight into the mapped capture file.
+ */
+struct TensorCaptureFrame
+{
+  const TensorCaptureRecord *record;
+  NvDsInferTensorMeta tensor_meta;
+  NvDsInferLayerInfo layers_info[TENSOR_CAPTURE_MAX_LAYERS];
+  void *host_buffers[TENSOR_CAPTURE_MAX_LAYERS];
+};
+
+class TensorCaptureReader
+{
+public:
+  TensorCaptureReader() : data(nullptr), size(0), dropped(0) {}
+
+  ~TensorCaptureReader()
+  {
+    close();
+  }
+
+  bool open(const char *path)
+  {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+      return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (uint64_t)st.st_size < sizeof(TensorCaptureHeader))
+    {
+      ::close(fd);
+      return false;
+    }
+
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+      return false;
+
+    this->data = (uint8_t *)map;
+    this->size = st.st_size;
+
+    const TensorCaptureHeader *header = (const TensorCaptureHeader *)this->data;
+    if (memcmp(header->magic, TENSOR_CAPTURE_MAGIC, sizeof(header->magic)) ||
+        header->version != TENSOR_CAPTURE_VERSION)
+    {
+      close();
+      return false;
+    }
+
+    this->offsets.clear();
+    this->dropped = 0;
+    if (header->index_offset && header->index_offset <= this->size &&
+        header->num_records <= (this->size - header->index_offset) / sizeof(uint64_t))
+    {
+      const uint64_t *index = (const uint64_t *)(this->data + header->index_offset);
+      for (uint64_t i = 0; i < header->num_records; i++)
+      {
+        if (recordValid(index[i]))
+          this->offsets.push_back(index[i]);
+        else
+          this->dropped++;
+      }
+    }
+    else
+    {
+      /* Capture was not closed cleanly, recover the complete records */
+      uint64_t offset = tensor_capture_align(sizeof(TensorCaptureHeader));
+      while (recordValid(offset))
+      {
+        this->offsets.push_back(offset);
+        offset += ((const TensorCaptureRecord *)(this->data + offset))->record_size;
+      }
+    }
+    return true;
+  }
+
+  void close()
+  {
+    if (this->data)
+      munmap(this->data, this->size);
+    this->data = nullptr;
+    this->size = 0;
+    this->offsets.clear();
+  }
+
+  inline int numFrames() const
+  {
+    return (int)this->offsets.size();
+  }
+
+  /* Records of the index that failed validation in open() and are skipped */
+  inline int droppedRecords() const
+  {
+    return this->dropped;
+  }
+
+  /**
+   * Fills 'frame' with zero-copy views of record 'i'
+   */
+  void frame(int i, TensorCaptureFrame &frame) const
+  {
+    const TensorCaptureRecord *record = (const TensorCaptureRecord *)(this->data + this->offsets[i]);
+    frame.record = record;
+    memset(&frame.tensor_meta, 0, sizeof(frame.tensor_meta));
+    memset(frame.layers_info, 0, sizeof(frame.layers_info));
+
+    for (int l = 0; l < TENSOR_CAPTURE_MAX_LAYERS; l++)
+    {
+      const TensorCaptureLayer &layer = record->layers[l];
+      NvDsInferLayerInfo &info = frame.layers_info[l];
+      info.dataType = (NvDsInferDataType)layer.data_type;
+      info.inferDims.numDims = layer.num_dims;
+      memcpy(info.inferDims.d, layer.d, sizeof(layer.d));
+      info.inferDims.numElements = layer.num_elements;
+      frame.host_buffers[l] = (void *)((const uint8_t *)record + layer.data_offset);
+    }
+
+    frame.tensor_meta.num_output_layers = TENSOR_CAPTURE_MAX_LAYERS;
+    frame.tensor_meta.output_layers_info = frame.layers_info;
+    frame.tensor_meta.out_buf_ptrs_host = frame.host_buffers;
+  }
+
+private:
+  /* Whether a complete record starts at 'offset' and all its layers lie inside it, sized for
+     their dims and element type */
+  bool recordValid(uint64_t offset) const
+  {
+    if (offset < tensor_capture_align(sizeof(TensorCaptureHeader)) || offset % TENSOR_CAPTURE_ALIGNMENT ||
+        offset > this->size || this->size - offset < sizeof(TensorCaptureRecord))
+      return false;
+    const TensorCaptureRecord *record = (const TensorCaptureRecord *)(this->data + offset);
+    if (record->magic != TENSOR_CAPTURE_RECORD_MAGIC || record->num_layers != TENSOR_CAPTURE_MAX_LAYERS ||
+        record->record_size < sizeof(TensorCaptureRecord) || record->record_size > this->size - offset)
+      return false;
+
+    for (int l = 0; l < TENSOR_CAPTURE_MAX_LAYERS; l++)
+    {
+      const TensorCaptureLayer &layer = record->layers[l];
+      if (layer.num_dims < 1 || layer.num_dims > NVDSINFER_MAX_DIMS ||
+          layer.data_offset < sizeof(TensorCaptureRecord) || layer.data_offset % TENSOR_CAPTURE_ALIGNMENT ||
+          layer.data_offset > record->record_size || layer.data_size > record->record_size - layer.data_offset)
+        return false;
+      uint64_t num_elements = 1;
+      for (uint32_t d = 0; d < layer.num_dims; d++)
+      {
+        if (!layer.d[d] || num_elements > layer.data_size / layer.d[d])
+          return false;
+        num_elements *= layer.d[d];
+      }
+      if (num_elements != layer.num_elements ||
+          num_elements * tensor_capture_element_size(layer.data_type) > layer.data_size)
+        return false;
+    }
+    return true;
+  }
+
+  uint8_t *data;
+  uint64_t size;
+  std::vector<uint64_t> offsets;
+  int dropped;
+};
@@ -0,0 +1,192 @@
+#pragma once
+
+/**
+ * Element types the post-processing reads the network outputs in. Engines
+ * built for FP16 or INT8 can hand their outputs over as half floats or as int8
+ * values with a quantization scale instead of float32. The kernels read a
+ * tensor through a TensorPtr, which converts to float on load, one element or
+ * SIMD_WIDTH lanes at a time. Both loads of the same element give the same
+ * float, so a kernel may mix them.
+ */
+
+#include "simd.hpp"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__F16C__) && !defined(POSE_SIMD_AVX2)
+#include <immintrin.h>
+#endif
+
+/* IEEE 754 half precision value, as TensorRT stores it */
+struct Half
+{
+  uint16_t bits;
+};
+
+/* A half rebiased to float by one multiplication by 2^112, exact for normal and subnormal
+   values. Infinities and NaNs become finite values of 65536 and more, which a cmap or paf
+   never holds. */
+static const uint32_t HALF_REBIAS_BITS = 0x77800000;
+
+inline float tensor_element_to_float(float value, float)
+{
+  return value;
+}
+
+inline float tensor_element_to_float(Half value, float)
+{
+#if defined(__F16C__)
+  return _cvtsh_ss(value.bits);
+#elif defined(POSE_SIMD_NEON)
+  __fp16 half;
+  memcpy(&half, &value.bits, sizeof(half));
+  return (float)half;
+#else
+  uint32_t bits = (uint32_t)(value.bits & 0x7fff) << 13;
+  float magnitude, rebias;
+  memcpy(&magnitude, &bits, sizeof(bits));
+  memcpy(&rebias, &HALF_REBIAS_BITS, sizeof(rebias));
+  magnitude *= rebias;
+  memcpy(&bits, &magnitude, sizeof(bits));
+  bits |= (uint32_t)(value.bits & 0x8000) << 16;
+  float result;
+  memcpy(&result, &bits, sizeof(bits));
+  return result;
+#endif
+}
+
+inline float tensor_element_to_float(int8_t value, float scale)
+{
+  return (float)value * scale;
+}
+
+inline simd_float simd_load_element(const float *p, float)
+{
+  return simd_load(p);
+}
+
+#if defined(POSE_SIMD_AVX2)
+/* Eight halves to float */
+inline simd_float simd_half_to_float(__m128i halves)
+{
+#if defined(__F16C__)
+  return _mm256_cvtph_ps(halves);
+#else
+  __m256i x = _mm256_cvtepu16_epi32(halves);
+  __m256i sign = _mm256_slli_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0x8000)), 16);
+  __m256i magnitude = _mm256_slli_epi32(_mm256_and_si256(x, _mm256_set1_epi32(0x7fff)), 13);
+  __m256 value = _mm256_mul_ps(_mm256_castsi256_ps(magnitude),
+                               _mm256_castsi256_ps(_mm256_set1_epi32(HALF_REBIAS_BITS)));
+  return _mm256_or_ps(value, _mm256_castsi256_ps(sign));
+#endif
+}
+#endif
+
+inline simd_float simd_load_element(const Half *p, float)
+{
+#if defined(POSE_SIMD_AVX2)
+  return simd_half_to_float(_mm_loadu_si128((const __m128i *)p));
+#elif defined(POSE_SIMD_SSE2) && defined(__F16C__)
+  return _mm_cvtph_ps(_mm_loadl_epi64((const __m128i *)p));
+#elif defined(POSE_SIMD_SSE2)
+  __m128i x = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)p), _mm_setzero_si128());
+  __m128i sign = _mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x8000)), 16);
+  __m128i magnitude = _mm_slli_epi32(_mm_and_si128(x, _mm_set1_epi32(0x7fff)), 13);
+  __m128 value = _mm_mul_ps(_mm_castsi128_ps(magnitude), _mm_castsi128_ps(_mm_set1_epi32(HALF_REBIAS_BITS)));
+  return _mm_or_ps(value, _mm_castsi128_ps(sign));
+#elif defined(POSE_SIMD_NEON)
+  return vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(&p->bits)));
+#else
+  float values[SIMD_WIDTH];
+  for (int lane = 0; lane < SIMD_WIDTH; lane++)
+    values[lane] = tensor_element_to_float(p[lane], 1.0f);
+  return simd_load(values);
+#endif
+}
+
+inline simd_float simd_load_element(const int8_t *p, float scale)
+{
+#if defined(POSE_SIMD_AVX2)
+  __m256i x = _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)p));
+  return _mm256_mul_ps(_mm256_cvtepi32_ps(x), _mm256_set1_ps(scale));
+#elif defined(POSE_SIMD_SSE2)
+  /* Sign extension without SSE4.1: move every byte to the top of its lane, shift back */
+  int32_t bytes;
+  memcpy(&bytes, p, sizeof(bytes));
+  __m128i x = _mm_cvtsi32_si128(bytes);
+  x = _mm_unpacklo_epi8(x, x);
+  x = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 24);
+  return _mm_mul_ps(_mm_cvtepi32_ps(x), _mm_set1_ps(scale));
+#elif defined(POSE_SIMD_NEON)
+  int32_t bytes;
+  memcpy(&bytes, p, sizeof(bytes));
+  int16x8_t x = vmovl_s8(vreinterpret_s8_s32(vdup_n_s32(bytes)));
+  return vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(x))), vdupq_n_f32(scale));
+#else
+  return tensor_element_to_float(*p, scale);
+#endif
+}
+
+/* Read-only pointer into a tensor of element type T that yields floats. 'scale' is the value
+   of one int8 quantization step and unused by the other types. */
+template <class T>
+struct TensorPtr
+{
+  explicit TensorPtr(const void *data, float scale = 1.0f) : data((const T *)data), scale(scale) {}
+
+  inline float operator[](int i) const
+  {
+    return tensor_element_to_float(this->data[i], this->scale);
+  }
+
+  inline TensorPtr operator+(int n) const
+  {
+    return TensorPtr(this->data + n, this->scale);
+  }
+
+  inline TensorPtr operator-(int n) const
+  {
+    return TensorPtr(this->data - n, this->scale);
+  }
+
+  const T *data;
+  float scale;
+};
+
+/* SIMD_WIDTH consecutive elements from 'p' */
+template <class T>
+inline simd_float simd_load(TensorPtr<T> p)
+{
+  return simd_load_element(p.data, p.scale);
+}
+
+/* base[index[i]] for every lane. Only float tensors have a gather instruction, the other
+   types gather their elements lane by lane and convert them in one go. */
+template <class T>
+inline simd_float simd_gather(TensorPtr<T> base, simd_float index)
+{
+  float lanes[SIMD_WIDTH];
+  T elements[SIMD_WIDTH];
+  simd_store(lanes, index);
+  for (int lane = 0; lane < SIMD_WIDTH; lane++)
+    elements[lane] = base.data[(int)lanes[lane]];
+  return simd_load_element(elements, base.scale);
+}
+
+inline simd_float simd_gather(TensorPtr<float> base, simd_float index)
+{
+  return simd_gather(base.data, index);
+}
+
+#if defined(POSE_SIMD_AVX2)
+/* Inserted lane by lane, a narrow store followed by a wide load would stall store forwarding */
+inline simd_float simd_gather(TensorPtr<Half> base, simd_float index)
+{
+  alignas(32) int lanes[8];
+  _mm256_store_si256((__m256i *)lanes, _mm256_cvttps_epi32(index));
+  const uint16_t *bits = &base.data->bits;
+  return simd_half_to_float(_mm_setr_epi16(bits[lanes[0]], bits[lanes[1]], bits[lanes[2]], bits[lanes[3]],
+                                           bits[lanes[4]], bits[lanes[5]], bits[lanes[6]], bits[lanes[7]]));
+}
+#endif